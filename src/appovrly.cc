@@ -25,6 +25,11 @@ class BrowserProcessHandler : public Browser, public CefBrowserProcessHandler {
       SubOnContextInitialized();
     }
 
+    void OnBeforeChildProcessLaunch(CefRefPtr<CefCommandLine> command_line) override
+    {
+      SubOnBeforeChildProcessLaunch(command_line);
+    }
+
   private:
     IMPLEMENT_REFCOUNTING(BrowserProcessHandler);
     DISALLOW_COPY_AND_ASSIGN(BrowserProcessHandler);
@@ -130,4 +135,8 @@ void runOnMain(std::function<void()> &&func) {
   CefPostTask(isbrowser ? cef_thread_id_t::TID_UI : cef_thread_id_t::TID_RENDERER, new FuncTask(std::move(func)));
 }
 
+void runOnMainAfter(int64_t delayms, std::function<void()> &&func) {
+  CefPostDelayedTask(isbrowser ? cef_thread_id_t::TID_UI : cef_thread_id_t::TID_RENDERER, new FuncTask(std::move(func)), delayms);
+}
+
 }} // module exports
@@ -26,6 +26,9 @@ namespace ovrly{ namespace process{
 class Browser {
   public:
     Event<> SubOnContextInitialized;
+
+    // Raised with the command line of each child process about to be launched, to add switches to
+    Event< CefRefPtr<CefCommandLine> > SubOnBeforeChildProcessLaunch;
 };
 
 /**
@@ -68,4 +71,9 @@ CefRefPtr<CefApp> Create();
 */
 void runOnMain(std::function<void()>&&);
 
+/**
+* Dispatch a function for execution on the main process thread after a delay in milliseconds.
+*/
+void runOnMainAfter(int64_t delayms, std::function<void()>&&);
+
 }} // namespace
@@ -43,6 +43,14 @@ namespace ogl {
     return std::make_shared<tex2>(this, width, height);
   }
 
+  pbo_ptr device::create_pbo(size_t size) {
+    return std::make_shared<pbo>(this, size);
+  }
+
+  fence_ptr device::create_fence() {
+    return std::make_shared<fence>(this);
+  }
+
   Context_ptr device::create_context() {
     return std::make_shared<Context>(window_);
   }
@@ -51,8 +59,31 @@ namespace ogl {
     return immediate_;
   }
 
+  Context_ptr device::create_shared_context() {
+    // A context per window, so sharing needs another ghost window
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    auto window = glfwCreateWindow(1, 1, "Ovrly opengl shared ghost", nullptr, window_);
+    if(!window) {
+      ovrly::logger::error("OGL error creating shared context");
+      return nullptr;
+    }
+    shared_.push_back(window);
+
+    // Loading the context makes it current, give this thread its immediate context back
+    auto ctx = std::make_shared<Context>(window);
+    immediate_->make_current();
+    return ctx;
+  }
+
+  void device::destroy_shared_contexts() {
+    for(auto window: shared_) {
+      glfwDestroyWindow(window);
+    }
+    shared_.clear();
+  }
+
   Context::Context(GLFWwindow* window) :
-   context_() {
+   window_(window), context_() {
     glfwMakeContextCurrent(window);
     int version = gladLoadGLContext(&context_, glfwGetProcAddress);
     if (version == 0)
@@ -64,6 +95,14 @@ namespace ogl {
     ovrly::logger::info("Loaded OpenGL {}.{}", GLAD_VERSION_MAJOR(version), GLAD_VERSION_MINOR(version));
   }
 
+  void Context::flush() {
+    context_.Flush();
+  }
+
+  void Context::make_current() {
+    glfwMakeContextCurrent(window_);
+  }
+
   device_ptr create_device()
   {
     return std::make_shared<device>();
@@ -79,19 +118,17 @@ namespace ogl {
     gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-    // Test contents
-    const unsigned char data[] = {
-      255, 0, 0, 255,
-      0, 255, 0, 255,
-      0, 0, 255, 255,
-      255, 255, 255, 255,
-    };
-    gl->TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    // Storage is immutable, a texture is never resized so copies never reallocate it
+    gl->TexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width_, height_);
     gl->BindTexture(GL_TEXTURE_2D, 0);
   }
 
   tex2::~tex2() {
-    device_->immediate_context()->gl()->DeleteTextures(1, &texture_);
+    auto gl = device_->immediate_context()->gl();
+    if(fence_) {
+      gl->DeleteSync(fence_);
+    }
+    gl->DeleteTextures(1, &texture_);
   }
 
   void tex2::bind(Context_ptr const& ctx) {
@@ -114,12 +151,133 @@ namespace ogl {
 
   void tex2::copy_from(const void* buffer) {
     if(context_) {
-      context_->gl()->TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width_, height_, 0, GL_BGRA, GL_UNSIGNED_BYTE, buffer);
+      context_->gl()->TexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width_, height_, GL_BGRA, GL_UNSIGNED_BYTE, buffer);
     }
   }
 
+  void tex2::copy_from(const void* buffer, int x, int y, int width, int height) {
+    if(!context_) return;
+
+    // Rows of the region are strided by the full buffer width
+    auto gl = context_->gl();
+    auto region = static_cast<const uint8_t*>(buffer) + (static_cast<size_t>(y) * width_ + x) * 4;
+    gl->PixelStorei(GL_UNPACK_ROW_LENGTH, width_);
+    gl->TexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_BGRA, GL_UNSIGNED_BYTE, region);
+    gl->PixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  }
+
+  void tex2::fence() {
+    if(!context_) return;
+
+    auto gl = context_->gl();
+    if(fence_) {
+      gl->DeleteSync(fence_);
+    }
+    fence_ = gl->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  bool tex2::ready() {
+    if(!fence_) return true;
+
+    // Flushing makes sure the fence gets to the GPU, otherwise it could never signal
+    auto gl = device_->immediate_context()->gl();
+    if(gl->ClientWaitSync(fence_, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) {
+      return false;
+    }
+
+    // Signaled, or failed and will never signal, either way there's no more waiting
+    gl->DeleteSync(fence_);
+    fence_ = nullptr;
+    return true;
+  }
+
   void *tex2::ovr_handle() const {
     return (void*)(uintptr_t)texture_;
   }
+
+  pbo::pbo(device *device, size_t size)
+  : device_(device), size_(size) {
+    auto gl = device_->immediate_context()->gl();
+    gl->GenBuffers(1, &buffer_);
+    gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer_);
+
+    // Coherent so writes through the mapping reach the GPU without flushing
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    gl->BufferStorage(GL_PIXEL_UNPACK_BUFFER, size_, nullptr, flags);
+    data_ = static_cast<uint8_t*>(gl->MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size_, flags));
+    if(!data_) {
+      ovrly::logger::error("OGL error mapping {} byte pixel buffer", size_);
+    }
+
+    gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+
+  pbo::~pbo() {
+    auto gl = device_->immediate_context()->gl();
+    if(fence_) {
+      gl->DeleteSync(fence_);
+    }
+
+    // Deleting the buffer unmaps it
+    gl->DeleteBuffers(1, &buffer_);
+  }
+
+  void pbo::bind(Context_ptr const& ctx) {
+    context_ = ctx;
+    context_->gl()->BindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer_);
+  }
+
+  void pbo::unbind() {
+    context_->gl()->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    context_.reset();
+  }
+
+  uint8_t *pbo::data() const {
+    return data_;
+  }
+
+  size_t pbo::size() const {
+    return size_;
+  }
+
+  void pbo::fence() {
+    if(!context_) return;
+
+    auto gl = context_->gl();
+    if(fence_) {
+      gl->DeleteSync(fence_);
+    }
+    fence_ = gl->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  bool pbo::wait(uint64_t timeout) {
+    if(!fence_) return true;
+
+    auto gl = device_->immediate_context()->gl();
+    if(gl->ClientWaitSync(fence_, GL_SYNC_FLUSH_COMMANDS_BIT, timeout) == GL_TIMEOUT_EXPIRED) {
+      return false;
+    }
+
+    gl->DeleteSync(fence_);
+    fence_ = nullptr;
+    return true;
+  }
+
+  fence::fence(device *device)
+  : device_(device) {
+    auto ctx = device_->immediate_context();
+    sync_ = ctx->gl()->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    // The fence has to reach the GPU for another context to wait on it
+    ctx->flush();
+  }
+
+  fence::~fence() {
+    device_->immediate_context()->gl()->DeleteSync(sync_);
+  }
+
+  void fence::wait(Context_ptr const& ctx) {
+    ctx->gl()->WaitSync(sync_, 0, GL_TIMEOUT_IGNORED);
+  }
 }
 
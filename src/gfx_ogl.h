@@ -11,6 +11,7 @@
 #include <memory>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "gl.hpp"
 #include <GLFW/glfw3.h>
@@ -21,6 +22,10 @@
 namespace ogl {
   class tex2;
   typedef std::shared_ptr<tex2> tex2_ptr;
+  class pbo;
+  typedef std::shared_ptr<pbo> pbo_ptr;
+  class fence;
+  typedef std::shared_ptr<fence> fence_ptr;
   class device;
   typedef std::shared_ptr<device> device_ptr;
 	device_ptr create_device();
@@ -32,6 +37,11 @@ namespace ogl {
 namespace gfx {
   using ogl::tex2;
   using ogl::tex2_ptr;
+  using ogl::pbo;
+  using ogl::pbo_ptr;
+  using ogl::fence;
+  using ogl::fence_ptr;
+  using ogl::Context_ptr;
 
   using ogl::device;
   using ogl::device_ptr;
@@ -55,10 +65,14 @@ namespace ogl {
 
 		void flush();
 
+    // Makes the context current on the calling thread, a context can only be current on one thread
+    void make_current();
+
     GladGLContext *gl() {
       return &context_;
     }
   private:
+    GLFWwindow *window_;
     GladGLContext context_;
 	};
 
@@ -66,9 +80,22 @@ namespace ogl {
   public:
     device();
 		tex2_ptr create_texture(int width, int height);
+    pbo_ptr create_pbo(size_t size);
+
+    // Fences the commands issued on the immediate context so far, objects it
+    // created are only guaranteed visible to shared contexts that wait on it
+    fence_ptr create_fence();
     Context_ptr create_context();
     Context_ptr immediate_context();
 
+    // Creates a real second context sharing textures, buffers and fences with the
+    // immediate one, for another thread to `make_current()` and use. Must be
+    // called on the thread the device was created on.
+    Context_ptr create_shared_context();
+
+    // Destroys the ghost windows of the shared contexts, once no thread is using them
+    void destroy_shared_contexts();
+
   private:
     // Hidden GL context window message pump
     std::unique_ptr<std::thread> zloop_;
@@ -76,6 +103,9 @@ namespace ogl {
     // The ghost window
     GLFWwindow* window_;
 
+    // Ghost windows owning the shared contexts
+    std::vector<GLFWwindow*> shared_;
+
     // Single-thread usage "immediate mode" context
     Context_ptr immediate_;
   };
@@ -96,18 +126,74 @@ namespace ogl {
     // A handle in the format expected by openvr overlay texture
     void* ovr_handle() const;
 
-    // Used for copying the CEF client area into a texture
+    // Used for copying the CEF client area into a texture, `buffer` is an offset when a `pbo` is bound
 		void copy_from(const void* buffer);
 
+    // Copies just a region of a full-size CEF client area buffer into the texture
+    void copy_from(const void* buffer, int x, int y, int width, int height);
+
+    // Marks the end of a batch of copies, `ready()` tells when the GPU has finished them
+    void fence();
+
+    // Whether the copies before the last `fence()` have finished, true if there was none
+    bool ready();
+
     ~tex2();
   private:
     device *device_;
     GLuint texture_;
     int width_;
     int height_;
+    GLsync fence_{ nullptr };
     Context_ptr context_;
 	};
 
+  // A persistently mapped pixel unpack buffer, texture copies from it are done
+  // by the GPU asynchronously instead of the driver copying the source first
+  class pbo
+  {
+  public:
+    pbo(device *device, size_t size);
+
+    // Used to un/bind the buffer as the source of texture copies
+    void bind(Context_ptr const& ctx);
+    void unbind();
+
+    // The mapping of the whole buffer, valid for the buffer's lifetime
+    uint8_t* data() const;
+    size_t size() const;
+
+    // Marks the end of the copies reading the buffer, `wait()` waits for them to finish
+    void fence();
+
+    // Waits up to `timeout` nanoseconds for the copies before the last `fence()` to finish reading the buffer
+    bool wait(uint64_t timeout);
+
+    ~pbo();
+  private:
+    device *device_;
+    GLuint buffer_;
+    size_t size_;
+    uint8_t *data_{ nullptr };
+    GLsync fence_{ nullptr };
+    Context_ptr context_;
+  };
+
+  // A point in the immediate context's commands for other contexts to wait on
+  class fence
+  {
+  public:
+    fence(device *device);
+
+    // Has the commands `ctx` issues after this wait on the GPU for the fenced ones
+    void wait(Context_ptr const& ctx);
+
+    ~fence();
+  private:
+    device *device_;
+    GLsync sync_;
+  };
+
 	template<class T>
 	class ScopedBinder
 	{
@@ -11,6 +11,14 @@
 #include <string>
 #include <functional>
 #include <thread>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
 
 #include <zmq.hpp>
 
@@ -19,7 +27,11 @@
 #include "webovrly.h"
 #include "uiovrly.h"
 #include "logging.h"
+#include "include/cef_command_line.h"
+#include "include/cef_parser.h"
+
 #include "serralize.hpp"
+#include "shmpose.h"
 
 namespace ovr = ::vr;
 
@@ -31,6 +43,8 @@ namespace ovrly { namespace js {
 // Module local
 namespace {
 
+  namespace wire = serralize::wire;
+
   // ZMQ context for browser _and_ render process zmq connections
   zmq::context_t zctx_{ 1 };
   const char* ZMQ_URL = "tcp://127.0.0.1:9995";
@@ -42,42 +56,585 @@ namespace {
   std::unique_ptr<std::thread> zloop_;
   std::atomic<bool> done{ false };
 
+  // Thread servicing requests on the rpc socket
+  std::unique_ptr<std::thread> rpcloop_;
+
+  // Replies to rpc calls are handed from the main thread to the rpc thread
+  // through this, since only the rpc thread can use the rpc socket
+  const char* ZMQ_RPC_REPLY_URL = "inproc://ovrly-rpc-replies";
+  std::unique_ptr<zmq::socket_t> replysock_;
+
+  // Render processes hand calls from JS to their rpc thread through this
+  const char* ZMQ_RPC_CALL_URL = "inproc://ovrly-rpc-calls";
+
+  // Status frame of an rpc reply, followed by the result or an error message
+  enum class RpcStatus : uint8_t {
+    Ok = 0,
+    Error = 1,
+  };
+
+  // Methods callable from JS, only used from the main thread
+  std::map<std::string, RpcMethod> methods_;
+
+  // How long a new context waits on the browser process for a state snapshot
+  const int SNAPSHOT_TIMEOUT_MS = 250;
+
+  // Furthest past photon time a context can extrapolate its predicted poses, in seconds
+  const double MAX_POSE_LOOKAHEAD = 0.1;
+
+  // Deepest nesting of JS values passed as call args
+  const int MAX_VALUE_DEPTH = 64;
+
+  // Last-value cache of each topic's full state, serialized as a keyframe, for new contexts.
+  // Written on the main thread and read from the rpc thread.
+  typedef std::shared_ptr<const std::vector<char>> CachedValue;
+  std::mutex lvcmutex_;
+  std::map<std::string, CachedValue> lvc_;
+
+  /**
+   * Serializes the full state for a topic into the last-value cache
+   */
+  template<typename T>
+  void cacheValue(const std::string &topic, const T &data) {
+    serralize::OutMemStream stream;
+    serialize(stream, data);
+    auto value = std::make_shared<const std::vector<char>>(std::move(stream.getBuf()));
+
+    std::lock_guard<std::mutex> lock(lvcmutex_);
+    lvc_[topic] = std::move(value);
+  }
+
+  // Receives every frame of a multipart message
+  bool recvFrames(zmq::socket_t &sock, std::vector<zmq::message_t> &frames) {
+    do {
+      frames.emplace_back();
+      if(!sock.recv(frames.back())) {
+        return false;
+      }
+    } while(frames.back().more());
+
+    return true;
+  }
+
+  // Sends every frame of a multipart message
+  void sendFrames(zmq::socket_t &sock, std::vector<zmq::message_t> &frames) {
+    for(size_t i = 0; i < frames.size(); ++i) {
+      sock.send(frames[i], i + 1 < frames.size() ? zmq::send_flags::sndmore : zmq::send_flags::none);
+    }
+  }
+
+  /**
+   * Replies to a snapshot request with a topic and body frame pair for each
+   * cached topic
+   */
+  void sendSnapshot(std::vector<zmq::message_t> &request) {
+    std::vector<std::pair<std::string, CachedValue>> values;
+    {
+      std::lock_guard<std::mutex> lock(lvcmutex_);
+      values.assign(lvc_.begin(), lvc_.end());
+    }
+
+    // Routing identity and call id
+    std::vector<zmq::message_t> reply;
+    reply.push_back(std::move(request[0]));
+    reply.push_back(std::move(request[1]));
+    auto status = RpcStatus::Ok;
+    reply.emplace_back(&status, sizeof(status));
+
+    for(auto &[topic, value]: values) {
+      reply.emplace_back(topic);
+
+      // The message holds a reference to the cached value until zmq is done with it
+      reply.emplace_back(
+        const_cast<char*>(value->data()), value->size(),
+        [](void* buf, void* ref) { delete static_cast<CachedValue*>(ref); },
+        new CachedValue(value)
+      );
+    }
+
+    sendFrames(*rpcsock_, reply);
+  }
+
+  /**
+   * Runs a method called from JS and hands the reply to the rpc thread
+   */
+  void callMethod(const std::string &identity, const std::string &id, const std::string &name, const std::string &args) {
+    auto status = RpcStatus::Ok;
+    std::string body;
+
+    auto method = methods_.find(name);
+    if(method == methods_.end()) {
+      status = RpcStatus::Error;
+      body = "Unknown method " + name;
+    } else {
+      try {
+        CefRefPtr<CefValue> argsval;
+        if(!args.empty() && !(argsval = CefParseJSON(args, JSON_PARSER_RFC))) {
+          throw std::invalid_argument("Malformed arguments to " + name);
+        }
+
+        auto result = method->second(argsval);
+        body = result ? CefWriteJSON(result, JSON_WRITER_DEFAULT).ToString() : "null";
+      } catch(std::exception &err) {
+        status = RpcStatus::Error;
+        body = err.what();
+      }
+    }
+
+    try {
+      if(!replysock_) {
+        replysock_ = std::make_unique<zmq::socket_t>(zctx_, zmq::socket_type::push);
+        replysock_->connect(ZMQ_RPC_REPLY_URL);
+      }
+
+      replysock_->send(zmq::message_t(identity), zmq::send_flags::sndmore);
+      replysock_->send(zmq::message_t(id), zmq::send_flags::sndmore);
+      replysock_->send(zmq::message_t(&status, sizeof(status)), zmq::send_flags::sndmore);
+      replysock_->send(zmq::message_t(body), zmq::send_flags::none);
+    } catch(zmq::error_t &err) {
+      logger::error("(js) Sending rpc reply failed: {}", err.what());
+    }
+  }
+
+  /**
+   * Services calls from render processes on the rpc socket
+   *
+   * Calls are frames of [identity, id, method, args], the identity is added by
+   * the router socket and used to route the reply. Replies are frames of
+   * [identity, id, status, body...]. Many calls can be in flight from each
+   * render process, replies are sent as each one completes.
+   */
+  void serveRpc() {
+    try {
+      zmq::socket_t replies(zctx_, zmq::socket_type::pull);
+      replies.bind(ZMQ_RPC_REPLY_URL);
+
+      std::vector<zmq::pollitem_t> items = {
+        { rpcsock_->handle(), 0, ZMQ_POLLIN, 0 },
+        { replies.handle(), 0, ZMQ_POLLIN, 0 },
+      };
+
+      while(true) {
+        zmq::poll(items);
+
+        // Route completed calls back to their callers
+        if(items[1].revents & ZMQ_POLLIN) {
+          std::vector<zmq::message_t> reply;
+          if(recvFrames(replies, reply)) {
+            sendFrames(*rpcsock_, reply);
+          }
+        }
+
+        if(items[0].revents & ZMQ_POLLIN) {
+          std::vector<zmq::message_t> request;
+          if(!recvFrames(*rpcsock_, request)) continue;
+
+          if(request.size() < 3) {
+            logger::error("(js) Dropping malformed rpc call");
+            continue;
+          }
+
+          auto method = request[2].to_string();
+
+          // Snapshots only need the cache, so don't wait on the main thread for them
+          if(method == "snapshot") {
+            sendSnapshot(request);
+            continue;
+          }
+
+          // Everything else runs on the main thread
+          process::runOnMain([
+            identity = request[0].to_string(),
+            id = request[1].to_string(),
+            method,
+            args = request.size() > 3 ? request[3].to_string() : ""s
+          ]() {
+            callMethod(identity, id, method, args);
+          });
+        }
+      }
+    } catch(zmq::error_t &err) {
+      if(err.num() != ETERM) {
+        logger::error("Error servicing zmq rpc: {}", err.what());
+      }
+      rpcsock_->close();
+    }
+  }
+
   // When the browser process is being created
   void onBrowserProcess(process::Browser& browser) {
     browser.SubOnContextInitialized.attach([]() {
-      // Setup and bind the zmq publish socket
-      zsock_ = std::make_unique<zmq::socket_t>(zctx_, zmq::socket_type::pub);
+      // Setup and bind the zmq publish socket, xpub lets us see subscriptions
+      zsock_ = std::make_unique<zmq::socket_t>(zctx_, zmq::socket_type::xpub);
       try {
+        // Pass along every (un)subscription, not just the first and last for a topic
+        zsock_->set(zmq::sockopt::xpub_verboser, 1);
         zsock_->bind(ZMQ_URL);
       } catch(zmq::error_t& err) {
         logger::error("Problem binding zmq listener: {}", err.what());
       }
 
-      // And the zmq rep socket
-      rpcsock_ = std::make_unique<zmq::socket_t>(zctx_, zmq::socket_type::rep);
+      // And the zmq router socket, which lets calls from each render process be pipelined
+      rpcsock_ = std::make_unique<zmq::socket_t>(zctx_, zmq::socket_type::router);
       try {
         rpcsock_->bind(ZMQ_RPC_URL);
       } catch(zmq::error_t& err) {
         logger::error("Problem binding zmq rpc listener: {}", err.what());
       }
+
+      // Calls are serviced off the main thread, which only runs the methods themselves
+      rpcloop_ = std::make_unique<std::thread>(serveRpc);
     });
   }
 
+  // Shared memory pose channel, mapped by render processes once it exists
+  std::unique_ptr<shm::PoseReader> posereader_;
+
+  /**
+   * Frees a natively allocated array buffer backing store once V8 is done with it
+   */
+  class FloatBufferRelease : public CefV8ArrayBufferReleaseCallback {
+    public:
+      void ReleaseBuffer(void* buffer) override {
+        delete[] static_cast<float*>(buffer);
+      }
+
+    private:
+      IMPLEMENT_REFCOUNTING(FloatBufferRelease);
+  };
+
+  /**
+   * Creates a `Float32Array` in the current context over a native buffer of
+   * `count` floats, which native code can then update in place
+   *
+   * V8 takes ownership of the buffer and frees it when the array is collected.
+   */
+  CefRefPtr<CefV8Value> createFloat32Array(float *buffer, size_t count) {
+    auto buf = CefV8Value::CreateArrayBuffer(buffer, count * sizeof(float), new FloatBufferRelease());
+
+    // There is no typed array constructor in the CEF API, so wrap the buffer from JS
+    CefRefPtr<CefV8Value> wrap;
+    CefRefPtr<CefV8Exception> exception;
+    if(!CefV8Context::GetCurrentContext()->Eval("(buf) => new Float32Array(buf)", "", 0, wrap, exception)) {
+      logger::error("(js) Unable to create Float32Array: {}", exception->GetMessage().ToString());
+      return nullptr;
+    }
+
+    return wrap->ExecuteFunction(nullptr, { buf });
+  }
+
   /**
-   * Marshals the data for a VR device into V8 objects and upserts them as
-   * properties onto `jsdevs`.
+   * Resolves `ovrly.devices.*.pose` from the shared memory pose channel when
+   * JS reads it, so poses are as fresh as possible and cost nothing unread.
+   *
+   * `pose.matrix` is a `Float32Array` over a native buffer that's updated in
+   * place, and `pose.seq` the frame it last changed in, so reading a pose
+   * creates no garbage for V8 to collect. `pose.predicted` is likewise the
+   * pose predicted for when the frame's photons are displayed, extrapolated
+   * further by the context's lookahead to cover its own latency.
    */
-  void loadDev(CefRefPtr<CefV8Value> const& jsdevs, vr::TrackedDevice &device) {
-    const wchar_t *name = L"none";
+  class PoseAccessor : public CefV8Accessor {
+    public:
+      PoseAccessor(unsigned slot, std::shared_ptr<const float> lookahead) : slot_(slot), lookahead_(lookahead) { }
+
+      bool Get(const CefString& name, const CefRefPtr<CefV8Value> object,
+        CefRefPtr<CefV8Value>& retval, CefString& exception) override
+      {
+        if(name != "pose" || !posereader_) {
+          return false;
+        }
+
+        // ovrly.devices.hmd.pose.matrix
+        if(!pose_) {
+          // Each array owns its buffer once created
+          auto matbuf = new float[16]{};
+          auto matrix = createFloat32Array(matbuf, 16);
+          if(!matrix) {
+            delete[] matbuf;
+            return false;
+          }
+
+          auto predbuf = new float[16]{};
+          auto predicted = createFloat32Array(predbuf, 16);
+          if(!predicted) {
+            delete[] predbuf;
+            return false;
+          }
+
+          matrix_ = matbuf;
+          predicted_ = predbuf;
+          pose_ = CefV8Value::CreateObject(nullptr, nullptr);
+          pose_->SetValue(L"matrix", matrix, readonly);
+          pose_->SetValue(L"predicted", predicted, readonly);
+          pose_->SetValue(L"seq", CefV8Value::CreateUInt(0), readonly);
+        }
+
+        // Only look at the record when a new frame has been published, keeping the
+        // last one when the writer holds it up, it's read again on the next access
+        auto frame = posereader_->frame();
+        if(frame != frame_) {
+          if(auto read = posereader_->read(slot_, record_)) {
+            frame_ = read;
+          }
+        }
+
+        // And only update the JS values when this device changed, or the lookahead did
+        if(record_.frame != seq_ || *lookahead_ != extrapolated_) {
+          seq_ = record_.frame;
+          extrapolated_ = *lookahead_;
+
+          // Update the device's position matrices in place
+          std::copy(std::begin(record_.matrix), std::end(record_.matrix), matrix_);
+          shm::extrapolate(record_.predicted, record_.velocity, record_.angular, extrapolated_, predicted_);
+
+          // Small enough to stay a V8 Smi for the lifetime of a session
+          pose_->SetValue(L"seq", CefV8Value::CreateUInt(static_cast<uint32_t>(seq_)), readonly);
+        }
+
+        retval = pose_;
+        return true;
+      }
+
+      bool Set(const CefString& name, const CefRefPtr<CefV8Value> object,
+        const CefRefPtr<CefV8Value> value, CefString& exception) override
+      {
+        return false;
+      }
+
+    private:
+      unsigned slot_;
+      std::shared_ptr<const float> lookahead_; // Seconds to extrapolate the predicted pose by
+      float extrapolated_{ 0 }; // Lookahead the predicted pose was last extrapolated by
+      uint64_t frame_{ 0 }; // Block frame the record was last read in
+      uint64_t seq_{ 0 }; // Frame the device last changed in, as of the JS values
+      shm::PoseRecord record_{};
+      CefRefPtr<CefV8Value> pose_;
+      float *matrix_{ nullptr }; // Backing store of `pose_.matrix`, kept alive by `pose_`
+      float *predicted_{ nullptr }; // Backing store of `pose_.predicted`, kept alive by `pose_`
+
+      IMPLEMENT_REFCOUNTING(PoseAccessor);
+  };
+
+  /**
+   * Implements `ovrly.setPoseLookahead(seconds)`, which sets how far past
+   * photon time a context's predicted poses are extrapolated
+   */
+  class LookaheadHandler : public CefV8Handler {
+    public:
+      LookaheadHandler(std::shared_ptr<float> lookahead) : lookahead_(lookahead) { }
+
+      bool Execute(const CefString& name, CefRefPtr<CefV8Value> object,
+        const CefV8ValueList& arguments, CefRefPtr<CefV8Value>& retval, CefString& exception) override
+      {
+        if(arguments.size() != 1 || !arguments[0]->IsDouble()) {
+          exception = "ovrly.setPoseLookahead requires a number of seconds";
+          return true;
+        }
+
+        // Extrapolating any further would only amplify noise in the angular velocity
+        auto seconds = arguments[0]->GetDoubleValue();
+        if(!std::isfinite(seconds) || seconds < 0.0 || seconds > MAX_POSE_LOOKAHEAD) {
+          exception = "ovrly.setPoseLookahead requires between 0 and 0.1 seconds";
+          return true;
+        }
+
+        *lookahead_ = static_cast<float>(seconds);
+        return true;
+      }
+
+    private:
+      std::shared_ptr<float> lookahead_;
+
+      IMPLEMENT_REFCOUNTING(LookaheadHandler);
+  };
+
+  // Converts a string viewed in a received message into a V8-compatible string
+  CefString toCefString(std::wstring_view str) {
+    CefString out;
+    cef_string_wide_to_utf16(str.data(), str.length(), out.GetWritableStruct());
+    return out;
+  }
+
+  // Whether a V8 value is left out of JSON, like `JSON.stringify` leaves it out
+  bool isUnserializable(CefRefPtr<CefV8Value> value) {
+    return !value || value->IsUndefined() || value->IsFunction();
+  }
+
+  /**
+   * Converts a V8 value into a CEF value following `JSON.stringify`, so it can
+   * be written as JSON without the page's own `JSON` object
+   *
+   * Returns null for values that can't be serialized, including nesting
+   * deeper than `MAX_VALUE_DEPTH`, which also catches cyclic objects.
+   */
+  CefRefPtr<CefValue> toCefValue(CefRefPtr<CefV8Value> value, int depth = 0) {
+    if(isUnserializable(value) || depth > MAX_VALUE_DEPTH) {
+      return nullptr;
+    }
+
+    auto out = CefValue::Create();
+    if(value->IsNull()) {
+      out->SetNull();
+    } else if(value->IsBool()) {
+      out->SetBool(value->GetBoolValue());
+    } else if(value->IsInt()) {
+      out->SetInt(value->GetIntValue());
+    } else if(value->IsDouble()) {
+      // Like JSON, numbers that aren't finite become null
+      auto number = value->GetDoubleValue();
+      if(std::isfinite(number)) {
+        out->SetDouble(number);
+      } else {
+        out->SetNull();
+      }
+    } else if(value->IsString()) {
+      out->SetString(value->GetStringValue());
+    } else if(value->IsArray()) {
+      auto list = CefListValue::Create();
+      auto length = value->GetArrayLength();
+      list->SetSize(length);
+      for(int i = 0; i < length; i++) {
+        // Items that are left out still hold their place as null
+        auto item = value->GetValue(i);
+        CefRefPtr<CefValue> converted;
+        if(isUnserializable(item)) {
+          converted = CefValue::Create();
+          converted->SetNull();
+        } else if(!(converted = toCefValue(item, depth + 1))) {
+          return nullptr;
+        }
+        list->SetValue(i, converted);
+      }
+      out->SetList(list);
+    } else if(value->IsObject()) {
+      auto dict = CefDictionaryValue::Create();
+      std::vector<CefString> keys;
+      value->GetKeys(keys);
+      for(auto &key: keys) {
+        auto item = value->GetValue(key);
+        if(isUnserializable(item)) {
+          continue;
+        }
+        auto converted = toCefValue(item, depth + 1);
+        if(!converted) {
+          return nullptr;
+        }
+        dict->SetValue(key, converted);
+      }
+      out->SetDictionary(dict);
+    } else {
+      return nullptr;
+    }
+
+    return out;
+  }
+
+  // Converts a CEF value, as parsed from JSON, into a V8 value
+  CefRefPtr<CefV8Value> toV8Value(CefRefPtr<CefValue> value) {
+    switch(value->GetType()) {
+      case VTYPE_NULL:
+        return CefV8Value::CreateNull();
+
+      case VTYPE_BOOL:
+        return CefV8Value::CreateBool(value->GetBool());
+
+      case VTYPE_INT:
+        return CefV8Value::CreateInt(value->GetInt());
+
+      case VTYPE_DOUBLE:
+        return CefV8Value::CreateDouble(value->GetDouble());
+
+      case VTYPE_STRING:
+        return CefV8Value::CreateString(value->GetString());
+
+      case VTYPE_LIST: {
+        auto list = value->GetList();
+        auto array = CefV8Value::CreateArray(static_cast<int>(list->GetSize()));
+        for(size_t i = 0; i < list->GetSize(); i++) {
+          array->SetValue(static_cast<int>(i), toV8Value(list->GetValue(i)));
+        }
+        return array;
+      }
+
+      case VTYPE_DICTIONARY: {
+        auto dict = value->GetDictionary();
+        auto object = CefV8Value::CreateObject(nullptr, nullptr);
+        CefDictionaryValue::KeyList keys;
+        dict->GetKeys(keys);
+        for(auto &key: keys) {
+          object->SetValue(key, toV8Value(dict->GetValue(key)), CefV8Value::V8_PROPERTY_ATTRIBUTE_NONE);
+        }
+        return object;
+      }
+
+      // JSON has no binary values
+      default:
+        return CefV8Value::CreateUndefined();
+    }
+  }
+
+  /**
+   * A device's state as last received from the browser process
+   */
+  struct DeviceEntry {
+    uint64_t version{ 0 }; // Table version this device last changed in
+    const wchar_t *name{ nullptr }; // JS property name, null for devices that aren't marshalled
+    bool connected{ false };
+    std::wstring manufacturer;
+    std::wstring model;
+    std::wstring serial;
+  };
+
+  /**
+   * The render process' copy of the device stream, shared by all of its contexts
+   *
+   * Messages are applied to it by the subscriber thread as they arrive, and
+   * contexts catch up with it on the main thread. However far behind the main
+   * thread falls, it only ever applies the latest state to JS.
+   */
+  struct DeviceTable {
+    std::mutex mutex;
+    bool synced{ false }; // A keyframe was applied and no messages were missed since
+    uint32_t sequence{ 0 }; // Sequence of the last message applied
+    uint64_t version{ 0 }; // Bumped whenever any device changes
+    std::map<unsigned, DeviceEntry> devices; // By slot
+  } devtable_;
+
+  // Whether a task draining the device table into JS is queued on the main thread
+  std::atomic<bool> drainpending_{ false };
+
+  /**
+   * A live JS context in this render process and the topics it listens to
+   */
+  struct ContextEntry {
+    CefRefPtr<CefV8Context> jsctx;
+    std::set<std::string> topics; // Subscribed topic prefixes
+    uint64_t devversion{ 0 }; // Device table version last applied to the context
+    std::shared_ptr<float> lookahead{ std::make_shared<float>(0.0f) }; // Seconds to extrapolate predicted poses past photon time
+  };
+
+  // Registry of live contexts, only used from the main thread
+  std::vector<ContextEntry> contexts_;
+
+  // Whether a context is subscribed to a prefix matching the topic
+  bool isSubscribed(const ContextEntry &entry, const std::string &topic) {
+    return std::any_of(entry.topics.begin(), entry.topics.end(), [&topic](const auto &prefix) {
+      return topic.starts_with(prefix);
+    });
+  }
+
+  // Gets the JS property name for a device, null if it's not one we marshal
+  const wchar_t *devName(const serralize::TrackedDeviceView &device) {
+    const wchar_t *name = nullptr;
 
     // See if it's a device we're interested in marshalling
-    switch(device.type) {
+    switch(device.type()) {
       case ovr::TrackedDeviceClass_HMD:
         name = L"hmd";
         break;
 
       case ovr::TrackedDeviceClass_Controller:
-        switch(device.role.value()) {
+        switch(device.role().value_or(ovr::TrackedControllerRole_Invalid)) {
 
           case ovr::TrackedControllerRole_LeftHand:
             name = L"left";
@@ -89,48 +646,469 @@ namespace {
 
           // Skip controllers that are invalid or have roles we don't care about
           default:
-            return;
+            break;
         }
         break;
 
       // Skip device classes we don't care about
       default:
-        return;
+        break;
     }
 
-    // Create the device if it doesn't exist yet, and set any static properties
-    // saving it in the device list by name.
-    if(!jsdevs->HasValue(name)) {
-      auto dev = CefV8Value::CreateObject(nullptr, nullptr);
-      dev->SetValue(L"manufacturer", CefV8Value::CreateString(device.manufacturer), readonly);
-      dev->SetValue(L"model", CefV8Value::CreateString(device.model), readonly);
-      dev->SetValue(L"serial", CefV8Value::CreateString(device.serial), readonly);
-      jsdevs->SetValue(name, dev, readonly);
+    return name;
+  }
+
+  /**
+   * Marshals a device's state into V8 objects and upserts them as properties
+   * onto `jsdevs`.
+   */
+  void loadDev(CefRefPtr<CefV8Value> const& jsdevs, unsigned slot, const DeviceEntry &device, std::shared_ptr<const float> lookahead) {
+    if(!device.name) {
+      return;
+    }
+
+    // Map the pose channel if the browser process has created it
+    if(!posereader_) {
+      auto name = CefCommandLine::GetGlobalCommandLine()->GetSwitchValue(shm::PoseBlockSwitch).ToString();
+      if(!name.empty()) {
+        posereader_ = shm::PoseReader::Open(name);
+      }
+    }
+
+    // Create the device if it doesn't exist yet, saving it in the device list by name.
+    if(!jsdevs->HasValue(device.name)) {
+      auto dev = CefV8Value::CreateObject(new PoseAccessor(slot, lookahead), nullptr);
+      // ovrly.devices.hmd.pose is read through the accessor
+      dev->SetValue(L"pose", readonly);
+      jsdevs->SetValue(device.name, dev, readonly);
     }
 
     // Get the object from the list by name
-    auto dev = jsdevs->GetValue(name);
+    auto dev = jsdevs->GetValue(device.name);
 
-    // Update mutable device properties
+    dev->SetValue(L"manufacturer", CefV8Value::CreateString(toCefString(device.manufacturer)), readonly);
+    dev->SetValue(L"model", CefV8Value::CreateString(toCefString(device.model)), readonly);
+    dev->SetValue(L"serial", CefV8Value::CreateString(toCefString(device.serial)), readonly);
     dev->SetValue(L"connected", CefV8Value::CreateBool(device.connected), readonly);
+  }
 
-    // Set/update the device's location in 3D space
-    if(device.pose) {
-      // Create the device pose and initialize it
-      if(!dev->HasValue(L"pose")) {
-        // ovrly.devices.hmd.pose.matrix
-        auto devmat = CefV8Value::CreateArray(12);
-        auto devpose = CefV8Value::CreateObject(nullptr, nullptr);
-        devpose->SetValue(L"matrix", devmat, readonly);
-        dev->SetValue(L"pose", devpose, readonly);
+  /**
+   * Applies the devices that changed in the table since a context last caught
+   * up with it to the context
+   *
+   * The changed devices are copied out under the table lock, so the
+   * subscriber thread isn't held up while they're marshalled into JS.
+   */
+  void syncDevices(ContextEntry &entry) {
+    std::vector<std::pair<unsigned, DeviceEntry>> changed;
+    uint64_t version;
+    {
+      std::lock_guard<std::mutex> lock(devtable_.mutex);
+      version = devtable_.version;
+      if(entry.devversion == version) {
+        return;
+      }
+
+      for(auto &[slot, device]: devtable_.devices) {
+        if(device.version > entry.devversion) {
+          changed.emplace_back(slot, device);
+        }
+      }
+    }
+
+    // Lock the JS context for mutation
+    // FIXME: wrap this in a scoped lock
+    entry.jsctx->Enter();
+
+    // Get the top-level `ovrly` property
+    auto ovrly = entry.jsctx->GetGlobal()->GetValue(L"ovrly");
+
+    // Create the device property
+    if(!ovrly->HasValue(L"devices")) {
+      auto jsdevs = CefV8Value::CreateObject(nullptr, nullptr);
+      ovrly->SetValue(L"devices", jsdevs, readonly);
+    }
+
+    // Marshal the native device data into JS
+    auto jsdevs = ovrly->GetValue(L"devices");
+    for(auto &[slot, device]: changed) {
+      loadDev(jsdevs, slot, device, entry.lookahead);
+    }
+    entry.devversion = version;
+
+    // Unlock the JS context
+    entry.jsctx->Exit();
+  }
+
+  /**
+   * Brings every context subscribed to devices up to date with the device table
+   */
+  void drainDevices() {
+    // Cleared first, so changes made while draining queue another drain
+    drainpending_ = false;
+
+    for(auto &entry: contexts_) {
+      if(isSubscribed(entry, "vr.devices")) {
+        syncDevices(entry);
+      }
+    }
+  }
+
+  /**
+   * Applies a device list message on top of the device table
+   *
+   * Returns whether any device changed.
+   */
+  bool applyDevices(const serralize::DeviceListView &devices) {
+    std::lock_guard<std::mutex> lock(devtable_.mutex);
+
+    // Skip messages the table already has, like those published before a snapshot was taken
+    if(devtable_.synced && static_cast<int32_t>(devices.sequence() - devtable_.sequence) <= 0) {
+      return false;
+    }
+
+    // Deltas only apply on top of the message directly before them, otherwise wait for a keyframe
+    if(!devices.keyframe() && (!devtable_.synced || devices.sequence() != devtable_.sequence + 1)) {
+      if(devtable_.synced) {
+        logger::debug("(js) Device stream gap at {}, waiting for keyframe", devices.sequence());
+      }
+      devtable_.synced = false;
+      return false;
+    }
+
+    devtable_.synced = true;
+    devtable_.sequence = devices.sequence();
+
+    bool changed = false;
+    for(auto dev: devices) {
+      // Tracking state alone isn't marshalled, poses are read from shared memory
+      if(!dev.has(wire::Info) && !dev.has(wire::Status)) {
+        continue;
+      }
+
+      auto &device = devtable_.devices[dev.slot()];
+
+      // Device identity only comes along with its info fields
+      if(dev.has(wire::Info)) {
+        device.name = devName(dev);
+        device.manufacturer = dev.manufacturer();
+        device.model = dev.model();
+        device.serial = dev.serial();
+      }
+
+      if(dev.has(wire::Status)) {
+        device.connected = dev.connected();
+      }
+
+      device.version = ++devtable_.version;
+      changed = true;
+    }
+
+    return changed;
+  }
+
+  /**
+   * Applies a message received for a topic to the process' state, and
+   * schedules draining it into JS if that changed anything
+   *
+   * At most one drain is queued at a time, so the main thread's queue stays
+   * bounded however quickly messages arrive.
+   */
+  void applyMessage(const std::string &topic, zmq::message_t &msg) {
+    // Records are read in place, so they need an aligned buffer
+    if(reinterpret_cast<uintptr_t>(msg.data()) % alignof(serralize::wire::DeviceRecord) != 0) {
+      msg = zmq::message_t(msg.data(), msg.size());
+    }
+
+    // View the message data in place
+    serralize::DeviceListView devices(msg.data(), msg.size());
+    if(!devices) {
+      logger::error("(js) Dropping malformed {} message", topic);
+      return;
+    }
+
+    if(applyDevices(devices) && !drainpending_.exchange(true)) {
+      process::runOnMain(drainDevices);
+    }
+  }
+
+  /**
+   * Loads a snapshot of the browser process' current state, unless the
+   * process already has it from serving an earlier context
+   */
+  void loadSnapshot() {
+    {
+      std::lock_guard<std::mutex> lock(devtable_.mutex);
+      if(devtable_.synced) {
+        return;
+      }
+    }
+
+    try {
+      // A one-off call, made synchronously so the state is there before any page script runs
+      zmq::socket_t sock(zctx_, zmq::socket_type::dealer);
+      sock.set(zmq::sockopt::rcvtimeo, SNAPSHOT_TIMEOUT_MS);
+      sock.set(zmq::sockopt::linger, 0);
+      sock.connect(ZMQ_RPC_URL);
+      sock.send(zmq::message_t(), zmq::send_flags::sndmore);
+      sock.send(zmq::str_buffer("snapshot"), zmq::send_flags::none);
+
+      // Reply is the id and status, then pairs of topic and body frames
+      std::vector<zmq::message_t> reply;
+      if(!recvFrames(sock, reply)) {
+        logger::error("(js) Timed out loading state snapshot");
+        return;
+      }
+
+      for(size_t i = 2; i + 1 < reply.size(); i += 2) {
+        applyMessage(reply[i].to_string(), reply[i + 1]);
+      }
+    } catch(zmq::error_t &err) {
+      logger::error("(js) Error loading state snapshot: {}", err.what());
+    }
+  }
+
+  // Thread relaying calls from JS to the browser process and their replies back
+  std::unique_ptr<std::thread> rpcclient_;
+
+  // Main thread end of the relay
+  std::unique_ptr<zmq::socket_t> callsock_;
+
+  // Calls from JS waiting on a reply, by call id, only used from the main thread
+  struct PendingCall {
+    CefRefPtr<CefV8Context> jsctx;
+    CefRefPtr<CefV8Value> promise;
+  };
+  std::map<uint32_t, PendingCall> pending_;
+  uint32_t nextcall_{ 0 };
+
+  /**
+   * Settles the promise of a call from JS with its reply
+   */
+  void completeCall(uint32_t id, RpcStatus status, const std::string &body) {
+    // The context that made the call may have gone away
+    auto it = pending_.find(id);
+    if(it == pending_.end()) {
+      return;
+    }
+    auto call = it->second;
+    pending_.erase(it);
+
+    call.jsctx->Enter();
+
+    if(status == RpcStatus::Ok) {
+      // Parsed natively, so a page replacing its `JSON` object can't change what it gets back
+      auto result = CefParseJSON(body, JSON_PARSER_RFC);
+      call.promise->ResolvePromise(result ? toV8Value(result) : CefV8Value::CreateUndefined());
+    } else {
+      call.promise->RejectPromise(body);
+    }
+
+    call.jsctx->Exit();
+  }
+
+  /**
+   * Relays calls handed over from the main thread to the browser process, and
+   * their replies back to the main thread
+   */
+  void relayRpc() {
+    logger::debug("(js) Spawned ZMQ rpc client thread");
+
+    try {
+      zmq::socket_t calls(zctx_, zmq::socket_type::pull);
+      calls.bind(ZMQ_RPC_CALL_URL);
+
+      // Dealer lets calls be pipelined rather than waiting on each reply in turn
+      zmq::socket_t sock(zctx_, zmq::socket_type::dealer);
+      sock.set(zmq::sockopt::linger, 0);
+      sock.connect(ZMQ_RPC_URL);
+
+      std::vector<zmq::pollitem_t> items = {
+        { sock.handle(), 0, ZMQ_POLLIN, 0 },
+        { calls.handle(), 0, ZMQ_POLLIN, 0 },
+      };
+
+      while(true) {
+        zmq::poll(items);
+
+        if(items[1].revents & ZMQ_POLLIN) {
+          std::vector<zmq::message_t> call;
+          if(recvFrames(calls, call)) {
+            sendFrames(sock, call);
+          }
+        }
+
+        if(items[0].revents & ZMQ_POLLIN) {
+          std::vector<zmq::message_t> reply;
+          if(!recvFrames(sock, reply)) continue;
+
+          // Reply is the call id, status, and body
+          if(reply.size() < 3 || reply[0].size() != sizeof(uint32_t) || reply[1].size() != sizeof(RpcStatus)) {
+            logger::error("(js) Dropping malformed rpc reply");
+            continue;
+          }
+
+          // Frames aren't guaranteed to be aligned for reading in place
+          uint32_t id;
+          RpcStatus status;
+          std::memcpy(&id, reply[0].data(), sizeof(id));
+          std::memcpy(&status, reply[1].data(), sizeof(status));
+
+          process::runOnMain([id, status, body = reply[2].to_string()]() {
+            completeCall(id, status, body);
+          });
+        }
+      }
+    } catch(zmq::error_t &err) {
+      if(err.num() != ETERM) {
+        logger::error("Error relaying zmq rpc: {}", err.what());
+      }
+    }
+  }
+
+  /**
+   * Implements `ovrly.call(method, args)`, which returns a promise for the
+   * result of calling a native method in the browser process
+   */
+  class CallHandler : public CefV8Handler {
+    public:
+      bool Execute(const CefString& name, CefRefPtr<CefV8Value> object,
+        const CefV8ValueList& arguments, CefRefPtr<CefV8Value>& retval, CefString& exception) override
+      {
+        if(arguments.empty() || !arguments[0]->IsString()) {
+          exception = "ovrly.call requires a method name";
+          return true;
+        }
+
+        auto jsctx = CefV8Context::GetCurrentContext();
+
+        // Args are passed along as JSON, written the same way the browser process writes results
+        std::string args;
+        if(arguments.size() > 1 && !arguments[1]->IsUndefined()) {
+          auto argsval = toCefValue(arguments[1]);
+          if(!argsval) {
+            exception = "ovrly.call args must be serializable to JSON";
+            return true;
+          }
+          args = CefWriteJSON(argsval, JSON_WRITER_DEFAULT).ToString();
+        }
+
+        auto id = ++nextcall_;
+        auto promise = CefV8Value::CreatePromise();
+
+        try {
+          if(!callsock_) {
+            callsock_ = std::make_unique<zmq::socket_t>(zctx_, zmq::socket_type::push);
+            callsock_->connect(ZMQ_RPC_CALL_URL);
+          }
+
+          callsock_->send(zmq::message_t(&id, sizeof(id)), zmq::send_flags::sndmore);
+          callsock_->send(zmq::message_t(arguments[0]->GetStringValue().ToString()), zmq::send_flags::sndmore);
+          callsock_->send(zmq::message_t(args), zmq::send_flags::none);
+
+          pending_[id] = { jsctx, promise };
+        } catch(zmq::error_t &err) {
+          promise->RejectPromise(err.what());
+        }
+
+        retval = promise;
+        return true;
       }
 
-      // Update the device's position matrix
-      auto devpose = dev->GetValue(L"pose");
-      auto devmat = devpose->GetValue(L"matrix");
-      for(int i = 0; i < 12; i++) {
-        devmat->SetValue(i, CefV8Value::CreateDouble(device.pose.value().matrix[i]));
+    private:
+      IMPLEMENT_REFCOUNTING(CallHandler);
+  };
+
+  // Subscription changes are handed from the main thread to the subscriber thread through this
+  const char* ZMQ_SUB_CONTROL_URL = "inproc://ovrly-sub-control";
+  std::unique_ptr<zmq::socket_t> controlsock_;
+
+  // Count of contexts subscribed to each topic prefix, the process' socket is
+  // subscribed to those with any
+  std::map<std::string, int> subcounts_;
+
+  /**
+   * Hands a (un)subscription to the subscriber thread, in the same format zmq
+   * uses on the wire: 1 for subscribe or 0 for unsubscribe, then the prefix.
+   */
+  void sendSubscription(bool subscribe, const std::string &prefix) {
+    try {
+      if(!controlsock_) {
+        controlsock_ = std::make_unique<zmq::socket_t>(zctx_, zmq::socket_type::push);
+        controlsock_->connect(ZMQ_SUB_CONTROL_URL);
       }
+
+      controlsock_->send(zmq::message_t(static_cast<char>(subscribe) + prefix), zmq::send_flags::none);
+    } catch(zmq::error_t &err) {
+      logger::error("(js) Changing subscription to '{}' failed: {}", prefix, err.what());
+    }
+  }
+
+  // Adds a topic prefix to a context's subscriptions
+  void subscribe(ContextEntry &entry, const std::string &prefix) {
+    if(entry.topics.insert(prefix).second && ++subcounts_[prefix] == 1) {
+      sendSubscription(true, prefix);
+    }
+  }
+
+  // Removes a topic prefix from a context's subscriptions
+  void unsubscribe(ContextEntry &entry, const std::string &prefix) {
+    if(entry.topics.erase(prefix) && --subcounts_[prefix] == 0) {
+      subcounts_.erase(prefix);
+      sendSubscription(false, prefix);
+    }
+  }
+
+  /**
+   * Receives messages published by the browser process for every context in
+   * this render process over a single subscriber socket
+   */
+  void receiveMessages() {
+    logger::debug("(js) Spawned ZMQ pubsub client thread");
+
+    try {
+      zmq::socket_t control(zctx_, zmq::socket_type::pull);
+      control.bind(ZMQ_SUB_CONTROL_URL);
+
+      // Setup and connect the zmq sub socket
+      zsock_ = std::make_unique<zmq::socket_t>(zctx_, zmq::socket_type::sub);
+      zsock_->connect(ZMQ_URL);
+
+      std::vector<zmq::pollitem_t> items = {
+        { zsock_->handle(), 0, ZMQ_POLLIN, 0 },
+        { control.handle(), 0, ZMQ_POLLIN, 0 },
+      };
+
+      while(true) {
+        zmq::poll(items);
+
+        // Apply subscription changes from the main thread
+        if(items[1].revents & ZMQ_POLLIN) {
+          zmq::message_t msg;
+          if(control.recv(msg) && msg.size() > 0) {
+            auto data = static_cast<const char*>(msg.data());
+            std::string prefix(data + 1, msg.size() - 1);
+            zsock_->set(data[0] ? zmq::sockopt::subscribe : zmq::sockopt::unsubscribe, prefix);
+          }
+        }
+
+        if(items[0].revents & ZMQ_POLLIN) {
+          // Got the envelope topic
+          zmq::message_t msg;
+          if(!zsock_->recv(msg)) continue;
+          auto topic = msg.to_string();
+
+          // Get the envelope body, js data is updated from it on the main thread
+          if(zsock_->recv(msg)) {
+            applyMessage(topic, msg);
+          }
+        }
+      }
+    } catch(zmq::error_t &err) {
+      if(err.num() != ETERM) {
+        logger::error("Error receiving zmq message: {}", err.what());
+      }
+      zsock_->close();
     }
   }
 
@@ -152,80 +1130,42 @@ namespace {
       ovrly->SetValue(L"initialized", CefV8Value::CreateBool(true), readonly);
       jsctx->GetGlobal()->SetValue(L"ovrly", ovrly, readonly);
 
+      // Calls to native methods in the browser process
+      ovrly->SetValue(L"call", CefV8Value::CreateFunction(L"call", new CallHandler()), readonly);
 
-      // TODO: Get currently live info from the VR subsystem without waiting
-      // for the next event, probably with the RPC socket
+      // All contexts in the process share one thread for each channel
+      if(!rpcclient_) {
+        rpcclient_ = std::make_unique<std::thread>(relayRpc);
+      }
+      if(!zloop_) {
+        zloop_ = std::make_unique<std::thread>(receiveMessages);
+      }
 
+      // Subscribe to particular pubsub topics
+      auto &entry = contexts_.emplace_back(ContextEntry{ jsctx });
 
-      // Start a thread to handle processing zmq pubsub messages sent from the
-      // browser process with which to update state in JS
-      zloop_ = std::make_unique<std::thread>([jsctx]() {
-        logger::debug("(js) Spawned ZMQ pubsub client thread");
+      // Lets the context cover its own render latency when using predicted poses
+      ovrly->SetValue(L"setPoseLookahead", CefV8Value::CreateFunction(L"setPoseLookahead", new LookaheadHandler(entry.lookahead)), readonly);
+      subscribe(entry, "vr.devices");
 
-        try {
-          // Setup and connect the zmq sub socket
-          zsock_ = std::make_unique<zmq::socket_t>(zctx_, zmq::socket_type::sub);
-          zsock_->connect(ZMQ_URL);
-
-          // Subscribe to particular pubsub topics
-          zsock_->set(zmq::sockopt::subscribe, "vr.devices");
-
-          while(1) {
-            // See if there is a message waiting
-            auto msg = std::make_shared<zmq::message_t>();
-            auto result = zsock_->recv(*msg);
-            if(result) {
-              // Got the envelope topic
-              auto topic = msg->to_string();
-
-              // Get the envelope body
-              result = zsock_->recv(*msg);
-              if(result) {
-                // Update js data on the main thread
-                process::runOnMain([jsctx, topic, msg]() {
-                  // Deserialize the message data
-                  serralize::InMemStream instream(msg->data(), msg->size());
-                  std::vector<vr::TrackedDevice> devices;
-                  deserialize(instream, &devices);
-
-                  // Lock the JS context for mutation
-                  // FIXME: wrap this in a scoped lock
-                  jsctx->Enter();
-
-                  // Get the top-level `ovrly` property
-                  auto ovrly = jsctx->GetGlobal()->GetValue(L"ovrly");
-
-                  // Create the device property
-                  if(!ovrly->HasValue(L"devices")) {
-                    auto jsdevs = CefV8Value::CreateObject(nullptr, nullptr);
-                    ovrly->SetValue(L"devices", jsdevs, readonly);
-                  }
-
-                  // Marshal the native device data into JS
-                  auto jsdevs = ovrly->GetValue(L"devices");
-                  for(auto &dev: devices) {
-                    loadDev(jsdevs, dev);
-                  }
-
-                  // Unlock the JS context
-                  jsctx->Exit();
-                });
-              }
-            }
-          }
-        } catch(zmq::error_t &err) {
-          if(err.num() != ETERM) {
-            logger::error("Error receiving zmq message: {}", err.what());
-          }
-          zsock_->close();
-        }
-      });
+      // Get currently live info from the VR subsystem without waiting for the
+      // next event, subsequent deltas apply on top of it
+      loadSnapshot();
+      syncDevices(entry);
     });
 
-    rp.SubOnContextReleased.attach([](auto browser, auto frame, auto jsctx) {
-      // Signal the zmq message loop thread to terminate
-      zctx_.close(); // blocks until sockets are closed
-      zloop_.reset();
+    rp.SubOnContextReleased.attach([](auto browser, auto frame, CefRefPtr<CefV8Context> jsctx) {
+      // Calls still in flight can't be settled in a released context
+      std::erase_if(pending_, [&jsctx](const auto &call) { return call.second.jsctx->IsSame(jsctx); });
+
+      // Drop the context's subscriptions, the process' connections stay up for other contexts
+      auto entry = std::find_if(contexts_.begin(), contexts_.end(), [&jsctx](const auto &e) { return e.jsctx->IsSame(jsctx); });
+      if(entry != contexts_.end()) {
+        for(auto topics = entry->topics; auto &prefix: topics) {
+          unsubscribe(*entry, prefix);
+        }
+        contexts_.erase(entry);
+      }
     });
   }
 
@@ -235,29 +1175,82 @@ namespace {
 
   }
 
+  // Count of live subscriptions to each topic prefix
+  std::map<std::string, int> subscriptions_;
+
+  // Handlers called when a subscription is made that matches their topic
+  std::vector<std::pair<std::string, std::function<void()>>> joinhandlers_;
+
+  /**
+   * Drains (un)subscription messages from the xpub socket to keep the live
+   * subscription counts current
+   */
+  void pollSubscriptions() {
+    zmq::message_t msg;
+    while(zsock_->recv(msg, zmq::recv_flags::dontwait)) {
+      if(msg.size() == 0) continue;
+
+      // First byte is 1 for a subscribe and 0 for an unsubscribe, the rest is the prefix
+      auto data = static_cast<const char*>(msg.data());
+      std::string prefix(data + 1, msg.size() - 1);
+
+      if(data[0] == 1) {
+        ++subscriptions_[prefix];
+        logger::debug("(js) subscribed to '{}'", prefix);
+
+        for(auto &[topic, handler]: joinhandlers_) {
+          if(topic.starts_with(prefix)) handler();
+        }
+      } else if(--subscriptions_[prefix] <= 0) {
+        subscriptions_.erase(prefix);
+      }
+    }
+  }
+
+  // Whether any render process is subscribed to a prefix matching the topic
+  bool hasSubscribers(const std::string &topic) {
+    pollSubscriptions();
+
+    return std::any_of(subscriptions_.begin(), subscriptions_.end(), [&topic](const auto &sub) {
+      return topic.starts_with(sub.first);
+    });
+  }
+
+  // Recycles serialization buffers between publishes
+  serralize::OutStreamPool streampool_;
+
+  // Count of published messages, for periodically reporting pool stats
+  size_t published_count_{ 0 };
+
   /**
    * Serializes some message object into a zmq message body and configures
    * garbage collection
    */
   template<typename T>
   zmq::message_t getZmqMessage(const T &data) {
-    // TODO: should we create a cache of outstreams to limit allocations?
-    auto outstream = new serralize::OutMemStream();
+    auto outstream = streampool_.acquire();
     serialize(*outstream, data);
 
     return {
       &outstream->getBuf()[0],
       outstream->getBuf().size(),
-      [](void* buf, void* sharedref) { delete static_cast<serralize::OutMemStream*>(sharedref); },
+      // Called by zmq, possibly from its io thread, once the message is sent
+      [](void* buf, void* sharedref) { streampool_.release(static_cast<serralize::OutMemStream*>(sharedref)); },
       outstream
     };
   }
 
   /**
    * Sends a serializable message object to render processes
+   *
+   * Nothing is serialized when no render process is subscribed to the topic.
    */
   template<typename T>
   void publishMessage(const std::string &topic, const T &data) {
+    if(!hasSubscribers(topic)) {
+      return;
+    }
+
     try {
       // Send the envelope topic part
       zsock_->send(zmq::message_t(topic), zmq::send_flags::sndmore);
@@ -265,28 +1258,318 @@ namespace {
       // Serialize the data and send it as the envelope body
       auto msg = getZmqMessage(data);
       zsock_->send(std::move(msg), zmq::send_flags::none);
+
+      if(++published_count_ % 1000 == 0) {
+        auto stats = streampool_.stats();
+        logger::debug("(js) stream pool hits {} misses {} drops {}", stats.hits, stats.misses, stats.drops);
+      }
     } catch(zmq::error_t &err) {
       logger::error("Sending zmq message failed: {}", err.what());
     }
   }
 
-  // Sends an updated device state list to the render processes
-  void sendDevices(std::shared_ptr<const std::vector<vr::TrackedDevice>> devices) {
-    publishMessage("vr.devices.updated", *devices.get());
+  // Publish a keyframe at least this often, in VR updates, so receivers recover from missed messages
+  const unsigned KEYFRAME_INTERVAL = 120;
+
+  const std::string DEVICES_TOPIC = "vr.devices.updated";
+
+  // The device state last published to render processes
+  std::vector<vr::TrackedDevice> published_;
+  uint32_t sequence_{ 0 };
+  unsigned keyframein_{ 0 }; // VR updates until the next keyframe is due
+
+  // The device state last written to the last-value cache, and the sequence it was written at
+  std::vector<vr::TrackedDevice> cached_;
+  std::optional<uint32_t> cachedsequence_;
+
+  // Gets the fields of a device that changed compared to an earlier device list
+  uint32_t dirtyFields(const std::vector<vr::TrackedDevice> &prevdevs, const vr::TrackedDevice &dev) {
+    auto prev = std::find_if(prevdevs.begin(), prevdevs.end(), [&dev](const auto &pd) { return pd.slot == dev.slot; });
+    if(prev == prevdevs.end()) {
+      return wire::AllFields;
+    }
+
+    uint32_t fields = 0;
+    if(prev->type != dev.type || prev->role != dev.role || prev->trackingStyle != dev.trackingStyle ||
+        prev->manufacturer != dev.manufacturer || prev->model != dev.model || prev->serial != dev.serial) {
+      fields |= wire::Info;
+    }
+
+    if(prev->connected != dev.connected) {
+      fields |= wire::Status;
+    }
+
+    // Poses themselves reach render processes through shared memory, only tracking changes are sent here
+    auto tracking = [](const vr::TrackedDevice &d) {
+      return d.pose ? std::make_pair(d.pose->valid, d.pose->result) : std::make_pair(false, ovr::TrackingResult_Uninitialized);
+    };
+    if(tracking(*prev) != tracking(dev)) {
+      fields |= wire::Pose;
+    }
+
+    return fields;
+  }
+
+  // Sends changes in device state to the render processes, or a keyframe when one is due
+  void sendDevices(const std::vector<vr::TrackedDevice> &devices) {
+    // Don't bother tracking changes with no one to send them to, a subscriber
+    // joining gets a keyframe
+    if(!hasSubscribers(DEVICES_TOPIC)) {
+      return;
+    }
+
+    bool keyframe = keyframein_ == 0;
+    keyframein_ = keyframe ? KEYFRAME_INTERVAL : keyframein_ - 1;
+
+    serralize::DeviceListUpdate update{ sequence_ + 1, keyframe };
+    for(auto &dev: devices) {
+      uint32_t fields = keyframe ? wire::AllFields : dirtyFields(published_, dev);
+      if(fields) {
+        update.devices.push_back({ &dev, fields });
+      }
+    }
+
+    // Nothing changed
+    if(!keyframe && update.devices.empty()) {
+      return;
+    }
+
+    publishMessage(DEVICES_TOPIC, update);
+    published_ = devices;
+    ++sequence_;
+  }
+
+  // Keeps the device keyframe in the last-value cache current
+  void cacheDevices(const std::vector<vr::TrackedDevice> &devices) {
+    // Only reserialize when something the keyframe carries, other than the pose, changed, or
+    // a message was published since, so new contexts can apply the messages that follow it
+    bool changed = cachedsequence_ != sequence_ || devices.size() != cached_.size() ||
+      std::any_of(devices.begin(), devices.end(), [](const auto &dev) {
+        return dirtyFields(cached_, dev) != 0;
+      });
+    if(!changed) {
+      return;
+    }
+
+    // Sequenced as of the last published message so deltas after it apply on top
+    serralize::DeviceListUpdate update{ sequence_, true };
+    for(auto &dev: devices) {
+      update.devices.push_back({ &dev, wire::AllFields });
+    }
+
+    cacheValue(DEVICES_TOPIC, update);
+    cached_ = devices;
+    cachedsequence_ = sequence_;
   }
 
   // The VR module is ready to go
   void onVRReady() {
     // Send the initial device state out to listeners
-    auto devices = std::make_shared<std::vector<vr::TrackedDevice>>(vr::getDevices());
-    sendDevices(devices);
+    auto devices = vr::getDevices();
+    sendDevices(*devices);
+    cacheDevices(*devices);
 //    auto playbounds = vr::getPlaybounds();
 //    setPlaybounds(playbounds);
   }
 
   // Device state updates from the VR module
-  void onDevicesUpdated(std::shared_ptr<const std::vector<vr::TrackedDevice>> devices) {
-    sendDevices(devices);
+  void onDevicesUpdated(vr::DeviceSnapshot devices) {
+    sendDevices(*devices);
+    cacheDevices(*devices);
+  }
+
+  // Gets a vector as a list of its components
+  template<typename T>
+  CefRefPtr<CefListValue> toList(const T *values, size_t count) {
+    auto list = CefListValue::Create();
+    list->SetSize(count);
+    for(size_t i = 0; i < count; ++i) {
+      list->SetDouble(i, values[i]);
+    }
+    return list;
+  }
+
+  // Play area bounds from the last query, until the chaperone changes
+  std::optional<ovr::HmdQuad_t> playbounds_;
+
+  void onChaperoneChanged(const ovr::VREvent_t &event) {
+    playbounds_.reset();
+  }
+
+  // vr.getPlaybounds() -> [[x, y, z], ...] corners of the play area in standing space
+  CefRefPtr<CefValue> getPlaybounds(CefRefPtr<CefValue> args) {
+    if(!playbounds_) {
+      playbounds_ = vr::getPlaybounds();
+    }
+    auto &bounds = *playbounds_;
+
+    auto corners = CefListValue::Create();
+    corners->SetSize(4);
+    for(size_t i = 0; i < 4; ++i) {
+      corners->SetList(i, toList(bounds.vCorners[i].v, 3));
+    }
+
+    auto result = CefValue::Create();
+    result->SetList(corners);
+    return result;
+  }
+
+  // Gets the slot an rpc call's args refer to
+  unsigned argSlot(CefRefPtr<CefValue> args, const char *method) {
+    if(!args || args->GetType() != VTYPE_DICTIONARY || args->GetDictionary()->GetType(L"slot") != VTYPE_INT) {
+      throw std::invalid_argument(std::string(method) + " requires a slot");
+    }
+    return args->GetDictionary()->GetInt(L"slot");
+  }
+
+  // Gets a numeric arg, JSON numbers without a fraction parse as ints
+  double argNumber(CefRefPtr<CefValue> args, const wchar_t *key, double fallback) {
+    auto dict = args->GetDictionary();
+    switch(dict->GetType(key)) {
+      case VTYPE_INT: return dict->GetInt(key);
+      case VTYPE_DOUBLE: return dict->GetDouble(key);
+      default: return fallback;
+    }
+  }
+
+  // vr.getDevice({ slot }) -> the device's properties, or null when there is no device in the slot
+  CefRefPtr<CefValue> getDevice(CefRefPtr<CefValue> args) {
+    auto slot = argSlot(args, "vr.getDevice");
+
+    auto result = CefValue::Create();
+    auto devices = vr::getDevices();
+    if(!devices) {
+      result->SetNull();
+      return result;
+    }
+
+    auto dev = std::find_if(devices->begin(), devices->end(), [slot](const auto &d) { return d.slot == slot; });
+    if(dev == devices->end()) {
+      result->SetNull();
+      return result;
+    }
+
+    auto props = CefDictionaryValue::Create();
+    props->SetInt(L"slot", dev->slot);
+    props->SetInt(L"type", dev->type);
+    props->SetBool(L"connected", dev->connected);
+    if(dev->role) props->SetInt(L"role", *dev->role);
+    if(dev->trackingStyle) props->SetInt(L"trackingStyle", *dev->trackingStyle);
+    props->SetString(L"manufacturer", dev->manufacturer);
+    props->SetString(L"model", dev->model);
+    props->SetString(L"serial", dev->serial);
+
+    result->SetDictionary(props);
+    return result;
+  }
+
+  // Gets a pose as a dictionary, with its time in seconds relative to `now`
+  CefRefPtr<CefDictionaryValue> toDictionary(const vr::DevicePose &pose, std::chrono::steady_clock::time_point time, std::chrono::steady_clock::time_point now) {
+    float matrix[16];
+    for(int i = 0; i < 16; ++i) {
+      matrix[i] = pose.matrix[i];
+    }
+
+    auto props = CefDictionaryValue::Create();
+    props->SetDouble(L"time", std::chrono::duration<double>(time - now).count());
+    props->SetList(L"matrix", toList(matrix, 16));
+    props->SetList(L"velocity", toList(&pose.velocity[0], 3));
+    props->SetList(L"angular", toList(&pose.angular[0], 3));
+    props->SetBool(L"valid", pose.valid);
+    props->SetInt(L"result", pose.result);
+    return props;
+  }
+
+  // vr.getPoseAt({ slot, time }) -> the device's pose `time` seconds from now, or null when it's outside the history
+  CefRefPtr<CefValue> getPoseAt(CefRefPtr<CefValue> args) {
+    auto slot = argSlot(args, "vr.getPoseAt");
+    auto now = std::chrono::steady_clock::now();
+    auto time = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(argNumber(args, L"time", 0)));
+
+    auto result = CefValue::Create();
+    if(auto pose = vr::poseAt(slot, time)) {
+      result->SetDictionary(toDictionary(*pose, time, now));
+    } else {
+      result->SetNull();
+    }
+    return result;
+  }
+
+  // vr.getPoseWindow({ slot, duration }) -> the device's sampled poses from the last `duration` seconds, oldest first
+  CefRefPtr<CefValue> getPoseWindow(CefRefPtr<CefValue> args) {
+    auto slot = argSlot(args, "vr.getPoseWindow");
+    auto duration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(argNumber(args, L"duration", 1)));
+
+    auto now = std::chrono::steady_clock::now();
+    auto poses = vr::window(slot, duration);
+
+    auto list = CefListValue::Create();
+    list->SetSize(poses.size());
+    for(size_t i = 0; i < poses.size(); ++i) {
+      list->SetDictionary(i, toDictionary(poses[i].pose, poses[i].time, now));
+    }
+
+    auto result = CefValue::Create();
+    result->SetList(list);
+    return result;
+  }
+
+  // vr.getSchedulerStats() -> timing of the VR thread's wakeups against the display
+  CefRefPtr<CefValue> getSchedulerStats(CefRefPtr<CefValue> args) {
+    auto stats = vr::getSchedulerStats();
+
+    auto props = CefDictionaryValue::Create();
+    props->SetDouble(L"frequency", stats.frequency);
+    props->SetDouble(L"phase", stats.phase);
+    props->SetDouble(L"frames", stats.frames);
+    props->SetDouble(L"missed", stats.missed);
+    props->SetDouble(L"jitterMean", stats.jitterMean);
+    props->SetDouble(L"jitterMax", stats.jitterMax);
+    props->SetDouble(L"photonsMean", stats.photonsMean);
+
+    auto result = CefValue::Create();
+    result->SetDictionary(props);
+    return result;
+  }
+
+  // vr.getEventStats() -> counters of the VR thread's runtime event handling
+  CefRefPtr<CefValue> getEventStats(CefRefPtr<CefValue> args) {
+    auto stats = vr::getEventStats();
+
+    auto props = CefDictionaryValue::Create();
+    props->SetInt(L"budget", stats.budget);
+    props->SetDouble(L"ticks", stats.ticks);
+    props->SetDouble(L"events", stats.events);
+    props->SetInt(L"maxPerTick", stats.maxPerTick);
+    props->SetDouble(L"deferred", stats.deferred);
+    props->SetDouble(L"skipped", stats.skipped);
+    props->SetDouble(L"mainDropped", stats.mainDropped);
+
+    auto result = CefValue::Create();
+    result->SetDictionary(props);
+    return result;
+  }
+
+  // vr.getUploadStats() -> timings of staging overlay paints and uploading them to their textures
+  CefRefPtr<CefValue> getUploadStats(CefRefPtr<CefValue> args) {
+    auto stats = vr::getUploadStats();
+
+    auto props = CefDictionaryValue::Create();
+    props->SetDouble(L"frames", stats.frames);
+    props->SetDouble(L"bytes", stats.bytes);
+    props->SetDouble(L"stageLast", stats.stageLast);
+    props->SetDouble(L"stageMean", stats.stageMean);
+    props->SetDouble(L"stageMax", stats.stageMax);
+    props->SetDouble(L"dropped", stats.dropped);
+    props->SetDouble(L"direct", stats.direct);
+    props->SetDouble(L"uploads", stats.uploads);
+    props->SetDouble(L"uploadLast", stats.uploadLast);
+    props->SetDouble(L"uploadMean", stats.uploadMean);
+    props->SetDouble(L"uploadMax", stats.uploadMax);
+
+    auto result = CefValue::Create();
+    result->SetDictionary(props);
+    return result;
   }
 
 } // module local
@@ -294,8 +1577,15 @@ namespace {
 
 /* */
 
+void registerMethod(const std::string &name, RpcMethod method) {
+  methods_[name] = std::move(method);
+}
+
 void registerHooks() {
   process::OnBrowser.attach(onBrowserProcess);
+
+  // New device subscribers need a keyframe before deltas are any use to them
+  joinhandlers_.push_back({ DEVICES_TOPIC, []() { keyframein_ = 0; } });
   process::OnRender.attach(onRenderProcess);
 
   // Hook notifications to get the browser-side client to render processes when they're created
@@ -305,6 +1595,17 @@ void registerHooks() {
   // Hook VR notifications
   vr::OnReady.attach(onVRReady);
   vr::OnDevicesUpdated.attach(onDevicesUpdated);
+  vr::OnVREvent(ovr::VREvent_ChaperoneUniverseHasChanged, vr::EventThread::Main).attach(onChaperoneChanged);
+  vr::OnVREvent(ovr::VREvent_ChaperoneDataHasChanged, vr::EventThread::Main).attach(onChaperoneChanged);
+
+  // Queries for state that isn't worth pushing to every context
+  registerMethod("vr.getPlaybounds", getPlaybounds);
+  registerMethod("vr.getDevice", getDevice);
+  registerMethod("vr.getSchedulerStats", getSchedulerStats);
+  registerMethod("vr.getEventStats", getEventStats);
+  registerMethod("vr.getUploadStats", getUploadStats);
+  registerMethod("vr.getPoseAt", getPoseAt);
+  registerMethod("vr.getPoseWindow", getPoseWindow);
 }
 
 }} // module exports
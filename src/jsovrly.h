@@ -8,6 +8,11 @@
  */
 #pragma once
 
+#include <functional>
+#include <string>
+
+#include "include/cef_values.h"
+
 /**
  * The purpose of this module is to define the native-to-js API and
  * the logic to do cross-process pub-sub to dispatch events from native code
@@ -22,6 +27,21 @@
  */
 
 namespace ovrly{ namespace js{
+  /**
+   * A native method that JS can call with `ovrly.call(name, args)`
+   *
+   * Called on the main thread of the browser process with the JSON-decoded
+   * args, which are null when none were passed. The returned value is
+   * JSON-encoded to resolve the JS promise, an exception thrown rejects it
+   * with the exception's message.
+   */
+  typedef std::function<CefRefPtr<CefValue>(CefRefPtr<CefValue> args)> RpcMethod;
+
+  /**
+   * Registers a method callable from JS by name, replacing any existing one
+   */
+  void registerMethod(const std::string &name, RpcMethod method);
+
   /**
    * Register javascript composition hooks
    */
@@ -87,6 +87,10 @@ int main(int argc, char *argv[]) {
   // Pump the CEF message loop until CefQuitMessageLoop() is called
   CefRunMessageLoop();
 
+  // Release the overlays and VR while CEF is still up to close their browsers
+  ovrly::mgr::shutdown();
+  ovrly::vr::shutdown();
+
   CefShutdown();
 
   return 0;
@@ -6,12 +6,15 @@
  * terms of the GNU General Public License as published by
  * the Free Software Foundation, version 3.
  */
+#include "mgrovrly.h"
 #include "appovrly.h"
 
 #include "ovrly.h"
 #include "vrovrly.h"
 #include "webovrly.h"
 #include "imgovrly.h"
+#include "jsovrly.h"
+#include "logging.h"
 
 namespace ovrly{ namespace mgr{
 
@@ -48,14 +51,80 @@ namespace {
     overlays_.push_back(std::move(imgoverlay));
   }
 
+  // Gets the overlay an rpc call's args refer to by `index`
+  vr::Overlay &argOverlay(CefRefPtr<CefValue> args) {
+    if(!args || args->GetType() != VTYPE_DICTIONARY || args->GetDictionary()->GetType(L"index") != VTYPE_INT) {
+      throw std::invalid_argument("An overlay index is required");
+    }
+
+    auto index = args->GetDictionary()->GetInt(L"index");
+    if(index < 0 || static_cast<size_t>(index) >= overlays_.size()) {
+      throw std::out_of_range("No overlay at index " + std::to_string(index));
+    }
+
+    return *overlays_[index];
+  }
+
+  // overlays.getTransform({ index }) -> column-major 4x4 transform matrix
+  CefRefPtr<CefValue> getTransform(CefRefPtr<CefValue> args) {
+    auto xform = argOverlay(args).getTransform();
+
+    auto matrix = CefListValue::Create();
+    matrix->SetSize(16);
+    for(int i = 0; i < 16; ++i) {
+      matrix->SetDouble(i, xform[i]);
+    }
+
+    auto result = CefValue::Create();
+    result->SetList(matrix);
+    return result;
+  }
+
+  // overlays.setTransform({ index, matrix }) with a column-major 4x4 transform matrix
+  CefRefPtr<CefValue> setTransform(CefRefPtr<CefValue> args) {
+    auto &overlay = argOverlay(args);
+
+    auto matrix = args->GetDictionary()->GetList(L"matrix");
+    if(!matrix || matrix->GetSize() != 16) {
+      throw std::invalid_argument("A 16 element matrix is required");
+    }
+
+    mathfu::mat4 xform;
+    for(int i = 0; i < 16; ++i) {
+      xform[i] = matrix->GetDouble(i);
+    }
+    overlay.setTransform(xform);
+
+    return nullptr;
+  }
+
+  // The runtime is shutting down, release the overlays while it's still there to release them to
+  void onVRQuit(const ::vr::VREvent_t &event) {
+    logger::info("(mgr) VR runtime quitting, destroying {} overlays", overlays_.size());
+    shutdown();
+
+    // Then stop polling it
+    vr::shutdown();
+  }
+
 }  // module local
 
 /*
  * Module exports
  */
 
+void shutdown() {
+  // Web overlays close their browsers as they go
+  overlays_.clear();
+}
+
 void registerHooks() {
   vr::OnReady.attach(onVRReady);
+  vr::OnVREvent(::vr::VREvent_Quit, vr::EventThread::Main).attach(onVRQuit);
+
+  // Let JS position overlays on demand
+  js::registerMethod("overlays.getTransform", getTransform);
+  js::registerMethod("overlays.setTransform", setTransform);
 }
 
 }} // module exports
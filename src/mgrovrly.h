@@ -26,4 +26,9 @@ namespace ovrly{ namespace mgr{
    * Registers to launch the ovrly UI once the browser process is initialized
    */
   void registerHooks();
+
+  /**
+   * Destroys the overlays, closing their browsers, before VR and CEF shut down
+   */
+  void shutdown();
 }} // namespaces
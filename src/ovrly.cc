@@ -0,0 +1,58 @@
+/*
+ * This file is part of ovrly (https://github.com/joshperry/ovrly)
+ * Copyright (c) 2020 Joshua Perry
+ *
+ * This program can be redistributed and/or modified under the
+ * terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ */
+#include "ovrly.h"
+
+#include <cmath>
+#include <string>
+
+#include "include/cef_command_line.h"
+
+#include "logging.h"
+
+namespace ovrly {
+
+std::optional<float> getFloatSwitch(const char *name) {
+  auto value = CefCommandLine::GetGlobalCommandLine()->GetSwitchValue(name).ToString();
+  if(value.empty()) {
+    return std::nullopt;
+  }
+
+  // The whole value has to be a finite number
+  try {
+    size_t used = 0;
+    auto parsed = std::stof(value, &used);
+    if(used == value.size() && std::isfinite(parsed)) {
+      return parsed;
+    }
+  } catch(std::exception &) { }
+
+  logger::error("Invalid value '{}' for --{}", value, name);
+  return std::nullopt;
+}
+
+std::optional<long> getIntSwitch(const char *name) {
+  auto value = CefCommandLine::GetGlobalCommandLine()->GetSwitchValue(name).ToString();
+  if(value.empty()) {
+    return std::nullopt;
+  }
+
+  // The whole value has to be a number
+  try {
+    size_t used = 0;
+    auto parsed = std::stol(value, &used);
+    if(used == value.size()) {
+      return parsed;
+    }
+  } catch(std::exception &) { }
+
+  logger::error("Invalid value '{}' for --{}", value, name);
+  return std::nullopt;
+}
+
+} // namespace
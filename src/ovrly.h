@@ -8,6 +8,12 @@
  */
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <utility>
+
 /**
  * The purpose of this module is to provide shared data structures and logic
  * that multiple modules can depend on without depending on eachother.
@@ -15,5 +21,157 @@
 
 namespace ovrly {
 
+  /**
+   * A fixed ring of buffers for handing immutable snapshots of some state from
+   * a single writer thread to any number of reader threads, without locks and
+   * without allocating once the buffers have grown to size.
+   *
+   * The writer fills a buffer no reader holds and publishes it, readers get a
+   * refcounted handle to the latest published buffer which keeps it from being
+   * reused until every handle to it is dropped. With readers only holding
+   * handles briefly, three buffers are enough for the writer to always find a
+   * free one, the rest are slack for readers that hold on to one.
+   */
+  template<typename T, size_t N = 4>
+  class SnapshotRing {
+    static_assert(N >= 3, "A free buffer needs to be available alongside the published one and one being read");
+
+    struct Slot {
+      std::atomic<unsigned> refs{ 0 };
+      T value{};
+    };
+
+    public:
+      /**
+       * A reference to a published snapshot, the snapshot is immutable while any
+       * handle to it exists
+       */
+      class Handle {
+        public:
+          Handle() {}
+          Handle(const Handle &other) : slot_(other.slot_) {
+            if(slot_) slot_->refs.fetch_add(1, std::memory_order_relaxed);
+          }
+          Handle(Handle &&other) : slot_(other.slot_) {
+            other.slot_ = nullptr;
+          }
+          ~Handle() {
+            if(slot_) slot_->refs.fetch_sub(1, std::memory_order_release);
+          }
+
+          Handle &operator=(Handle other) {
+            std::swap(slot_, other.slot_);
+            return *this;
+          }
+
+          explicit operator bool() const { return slot_ != nullptr; }
+          const T &operator*() const { return slot_->value; }
+          const T *operator->() const { return &slot_->value; }
+
+        private:
+          friend class SnapshotRing;
+          Handle(Slot *slot) : slot_(slot) {}
+
+          Slot *slot_{ nullptr };
+      };
+
+      /**
+       * Gets the buffer to write the next snapshot into, null when readers hold
+       * every buffer
+       *
+       * The buffer holds whatever snapshot was last written to it, so updating
+       * it in place reuses its allocations. Writer thread only.
+       */
+      T *back() {
+        auto published = published_.load(std::memory_order_relaxed);
+        for(size_t i = 0; i < N; ++i) {
+          // Ordered with readers claiming a slot before checking it's still published
+          if(i != published && slots_[i].refs.load(std::memory_order_seq_cst) == 0) {
+            back_ = i;
+            return &slots_[i].value;
+          }
+        }
+
+        back_ = N;
+        return nullptr;
+      }
+
+      /** Publishes the buffer last gotten from `back()` as the latest snapshot. Writer thread only. */
+      void publish() {
+        if(back_ < N) {
+          published_.store(back_, std::memory_order_seq_cst);
+          back_ = N;
+        }
+      }
+
+      /** Gets a handle to the latest published snapshot, empty if none has been published */
+      Handle acquire() {
+        while(true) {
+          auto index = published_.load(std::memory_order_acquire);
+          if(index >= N) {
+            return {};
+          }
+
+          // Claim the slot, then make sure the writer hadn't already moved on to reuse it
+          auto &slot = slots_[index];
+          slot.refs.fetch_add(1, std::memory_order_seq_cst);
+          if(published_.load(std::memory_order_seq_cst) == index) {
+            return Handle(&slot);
+          }
+          slot.refs.fetch_sub(1, std::memory_order_release);
+        }
+      }
+
+    private:
+      std::array<Slot, N> slots_;
+      std::atomic<size_t> published_{ N };
+      size_t back_{ N };
+  };
+
+  /**
+   * A fixed-size queue for handing values from a single producer thread to a
+   * single consumer thread, without locks and without allocating
+   */
+  template<typename T, size_t N>
+  class SpscQueue {
+    public:
+      /** Adds a value to the back, false when the queue is full. Producer thread only. */
+      bool push(T &&value) {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        if(tail - head_.load(std::memory_order_acquire) == N) {
+          return false;
+        }
+
+        slots_[tail % N] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+      }
+
+      /** Takes the value from the front, false when the queue is empty. Consumer thread only. */
+      bool pop(T &out) {
+        auto head = head_.load(std::memory_order_relaxed);
+        if(head == tail_.load(std::memory_order_acquire)) {
+          return false;
+        }
+
+        // Moving out leaves nothing held in the slot until it's reused
+        out = std::move(slots_[head % N]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+      }
+
+    private:
+      std::array<T, N> slots_;
+
+      // On their own cache lines so the threads don't contend for them
+      alignas(64) std::atomic<size_t> head_{ 0 };
+      alignas(64) std::atomic<size_t> tail_{ 0 };
+  };
+
+  /** Gets the value of a numeric command line switch, if it was given as a finite number */
+  std::optional<float> getFloatSwitch(const char *name);
+
+  /** Gets the value of an integer command line switch, if it was given as one */
+  std::optional<long> getIntSwitch(const char *name);
 
 }
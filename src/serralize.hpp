@@ -17,6 +17,13 @@
   * incredibly fast blitting serialization method.
   *
   * Based somewhat on the concepts discussed here: https://accu.org/index.php/journals/2317
+  *
+  * Types with non-POD members (like `vr::TrackedDevice`) are instead written in a flat, versioned
+  * layout of fixed-size records referencing a trailing string table by offset and length, which
+  * receivers read in place through view types without materializing anything.
+  *
+  * Device lists are sent either as keyframes carrying every field of every device, or as deltas
+  * carrying only the changed fields of changed devices, which receivers apply to their own state.
   */
 
 #include <string>
@@ -26,20 +33,42 @@
 #include <sstream>
 #include <iterator>
 #include <ranges>
+#include <span>
+#include <string_view>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <mutex>
 
 namespace ovrly { namespace serralize { // yes, I can spell even though I'm an sc2 fan
 
+  /**
+   * Rounds a buffer size up to its power-of-two size class
+   */
+  inline size_t sizeClass(size_t size) {
+    return std::bit_ceil(std::max<size_t>(size, 256));
+  }
+
   /**
    * Implements an autogrowing buffer to act as a simple memory write stream
    */
   class OutMemStream {
   public:
-    OutMemStream() : buf_{} {
-      buf_.reserve(1024 * 1000); // Preallocate buffer space to minimize allocations/copies
+    OutMemStream(size_t reserve = 256) : buf_{} {
+      buf_.reserve(sizeClass(reserve)); // Preallocate buffer space to minimize allocations/copies
     }
     inline void write(const void* p, size_t size) {
+      // Grow by size class rather than leaving it to the vector's growth policy
+      if(buf_.size() + size > buf_.capacity()) {
+        buf_.reserve(sizeClass(buf_.size() + size));
+      }
       auto cp = static_cast<const char*>(p);
-      std::copy(cp, cp + size, std::back_inserter(buf_));
+      buf_.insert(buf_.end(), cp, cp + size);
+    }
+
+    // Empties the stream while keeping its allocation for reuse
+    void reset() {
+      buf_.clear();
     }
 
     std::vector<char> &getBuf() {
@@ -50,6 +79,81 @@ namespace ovrly { namespace serralize { // yes, I can spell even though I'm an s
     std::vector<char> buf_;
   };
 
+  /**
+   * A bounded pool of `OutMemStream`s so that serializing a message doesn't
+   * need a fresh allocation each time.
+   *
+   * Streams can be released back to the pool from any thread, like a zmq free
+   * callback running on a zmq io thread.
+   */
+  class OutStreamPool {
+  public:
+    struct Stats {
+      size_t hits; // Acquires satisfied from the pool
+      size_t misses; // Acquires that had to allocate a new stream
+      size_t drops; // Releases deleted because the pool was full or the stream oversized
+    };
+
+    OutStreamPool(size_t capacity = 16) : capacity_{ capacity } {
+      free_.reserve(capacity);
+    }
+
+    ~OutStreamPool() {
+      for(auto stream: free_)
+        delete stream;
+    }
+
+    // Gets an empty stream, reusing a pooled one if available
+    OutMemStream *acquire() {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!free_.empty()) {
+          auto stream = free_.back();
+          free_.pop_back();
+          ++hits_;
+          return stream;
+        }
+      }
+
+      // Size new streams for the messages we've actually been sending
+      ++misses_;
+      return new OutMemStream(hint_.load(std::memory_order_relaxed));
+    }
+
+    // Returns a stream to the pool once its data is no longer referenced
+    void release(OutMemStream *stream) {
+      auto size = stream->getBuf().size();
+      hint_.store(size, std::memory_order_relaxed);
+
+      // Don't hang on to streams that grew far beyond what's typical
+      if(stream->getBuf().capacity() <= sizeClass(size) * 4) {
+        stream->reset();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(free_.size() < capacity_) {
+          free_.push_back(stream);
+          return;
+        }
+      }
+
+      ++drops_;
+      delete stream;
+    }
+
+    Stats stats() const {
+      return { hits_.load(), misses_.load(), drops_.load() };
+    }
+
+  private:
+    size_t capacity_;
+    std::mutex mutex_;
+    std::vector<OutMemStream*> free_;
+    std::atomic<size_t> hint_{ 0 };
+    std::atomic<size_t> hits_{ 0 };
+    std::atomic<size_t> misses_{ 0 };
+    std::atomic<size_t> drops_{ 0 };
+  };
+
   /**
    * Implements position tracking over a buffer to act as a simple memory read stream
    */
@@ -93,29 +197,266 @@ namespace ovrly { namespace serralize { // yes, I can spell even though I'm an s
     new(s) std::basic_string<T>(static_cast<T*>(i.pos_ptr(l)), l / sizeof(T));
   }
 
-  void serialize(OutMemStream& o, const vr::TrackedDevice& dev) {
-    // Write the object memory to capture POD members
-    o.write(&dev, sizeof(vr::TrackedDevice));
+  namespace wire {
+    constexpr uint32_t DeviceListMagic = 0x4c44564f; // "OVDL"
+    constexpr uint32_t DeviceListVersion = 2;
+
+    // Location of a string in the message's string table
+    struct StringRef {
+      uint32_t offset; // Byte offset from the start of the message
+      uint32_t length; // Length in characters
+    };
 
-    // Individually serialize non-pod members
-    serialize(o, dev.manufacturer);
-    serialize(o, dev.model);
-    serialize(o, dev.serial);
+    enum DeviceListKind : uint32_t {
+      Keyframe = 0, // Every field of every known device
+      Delta = 1, // Only changed fields of changed devices since the previous message
+    };
+
+    struct DeviceListHeader {
+      uint32_t magic;
+      uint32_t version;
+      uint32_t count; // Number of `DeviceRecord`s directly following the header
+      uint32_t size; // Total byte size of the message
+      uint32_t sequence; // Incremented for each message, for receivers to detect gaps
+      uint32_t kind; // `DeviceListKind`
+    };
+
+    // Groups of record fields that are tracked and sent as a unit
+    enum DeviceFields : uint32_t {
+      Info = 1 << 0, // type, role, trackingStyle, and strings
+      Status = 1 << 1, // connected flag
+      Pose = 1 << 2, // pose flags, result, matrix, and velocities
+      AllFields = Info | Status | Pose,
+    };
+
+    enum DeviceFlags : uint32_t {
+      Connected = 1 << 0,
+      HasRole = 1 << 1,
+      HasTrackingStyle = 1 << 2,
+      HasPose = 1 << 3,
+      PoseValid = 1 << 4,
+    };
+
+    struct DeviceRecord {
+      uint32_t slot;
+      uint32_t fields; // `DeviceFields` present in this record
+      uint32_t flags; // `DeviceFlags`
+      int32_t type; // `::vr::TrackedDeviceClass`
+      int32_t role; // `::vr::ETrackedControllerRole` when `HasRole`
+      int32_t trackingStyle; // `::vr::EHmdTrackingStyle` when `HasTrackingStyle`
+      int32_t result; // `::vr::ETrackingResult` when `HasPose`
+      float matrix[16]; // Column-major, same layout as `mathfu::mat4`
+      float velocity[3];
+      float angular[3];
+      StringRef manufacturer;
+      StringRef model;
+      StringRef serial;
+    };
+
+    // Keeps string table offsets aligned for in-place `wchar_t` access
+    static_assert(sizeof(DeviceListHeader) % alignof(wchar_t) == 0 && sizeof(DeviceRecord) % alignof(wchar_t) == 0);
   }
 
-  void deserialize(InMemStream &i, vr::TrackedDevice *dev) {
-    // Destruct the member non-pods
-    dev->manufacturer.~basic_string();
-    dev->model.~basic_string();
-    dev->serial.~basic_string();
+  /**
+   * Read-only accessor over a device record in a received device list message
+   */
+  class TrackedDeviceView {
+  public:
+    TrackedDeviceView(const char *base, const wire::DeviceRecord *rec) : base_{ base }, rec_{ rec } {}
+
+    unsigned slot() const { return rec_->slot; }
+    bool has(wire::DeviceFields fields) const { return (rec_->fields & fields) == fields; }
 
-    // Restore the object memory
-    i.read(dev, sizeof(vr::TrackedDevice));
+    ::vr::TrackedDeviceClass type() const { return static_cast<::vr::TrackedDeviceClass>(rec_->type); }
+    bool connected() const { return rec_->flags & wire::Connected; }
 
-    // Restore the member non-pods
-    deserialize(i, &dev->manufacturer);
-    deserialize(i, &dev->model);
-    deserialize(i, &dev->serial);
+    std::optional<::vr::ETrackedControllerRole> role() const {
+      if(!(rec_->flags & wire::HasRole)) return std::nullopt;
+      return static_cast<::vr::ETrackedControllerRole>(rec_->role);
+    }
+
+    std::optional<::vr::EHmdTrackingStyle> trackingStyle() const {
+      if(!(rec_->flags & wire::HasTrackingStyle)) return std::nullopt;
+      return static_cast<::vr::EHmdTrackingStyle>(rec_->trackingStyle);
+    }
+
+    bool hasPose() const { return rec_->flags & wire::HasPose; }
+    bool poseValid() const { return rec_->flags & wire::PoseValid; }
+    ::vr::ETrackingResult result() const { return static_cast<::vr::ETrackingResult>(rec_->result); }
+    std::span<const float, 16> matrix() const { return std::span<const float, 16>{ rec_->matrix }; }
+    std::span<const float, 3> velocity() const { return std::span<const float, 3>{ rec_->velocity }; }
+    std::span<const float, 3> angular() const { return std::span<const float, 3>{ rec_->angular }; }
+
+    std::wstring_view manufacturer() const { return str(rec_->manufacturer); }
+    std::wstring_view model() const { return str(rec_->model); }
+    std::wstring_view serial() const { return str(rec_->serial); }
+
+  private:
+    std::wstring_view str(const wire::StringRef &ref) const {
+      return { reinterpret_cast<const wchar_t*>(base_ + ref.offset), ref.length };
+    }
+
+    const char *base_;
+    const wire::DeviceRecord *rec_;
+  };
+
+  /**
+   * Validates and gives in-place access to a serialized device list
+   *
+   * The view borrows the message buffer, which must outlive it and be aligned
+   * for `wire::DeviceRecord`.
+   */
+  class DeviceListView {
+  public:
+    class iterator {
+    public:
+      iterator(const char *base, const wire::DeviceRecord *rec) : base_{ base }, rec_{ rec } {}
+      TrackedDeviceView operator*() const { return { base_, rec_ }; }
+      iterator &operator++() { ++rec_; return *this; }
+      bool operator!=(const iterator &other) const { return rec_ != other.rec_; }
+    private:
+      const char *base_;
+      const wire::DeviceRecord *rec_;
+    };
+
+    DeviceListView(const void *buf, size_t size) : base_{ static_cast<const char*>(buf) } {
+      valid_ = validate(size);
+    }
+
+    // Whether the buffer held a well-formed device list of the current version
+    explicit operator bool() const { return valid_; }
+
+    bool keyframe() const { return header()->kind == wire::Keyframe; }
+    uint32_t sequence() const { return header()->sequence; }
+
+    std::span<const wire::DeviceRecord> records() const {
+      if(!valid_) return {};
+      return { reinterpret_cast<const wire::DeviceRecord*>(base_ + sizeof(wire::DeviceListHeader)), header()->count };
+    }
+
+    size_t size() const { return records().size(); }
+    TrackedDeviceView operator[](size_t i) const { return { base_, &records()[i] }; }
+    iterator begin() const { return { base_, records().data() }; }
+    iterator end() const { return { base_, records().data() + records().size() }; }
+
+  private:
+    const wire::DeviceListHeader *header() const {
+      return reinterpret_cast<const wire::DeviceListHeader*>(base_);
+    }
+
+    // Checks the header and that every string reference is in bounds
+    bool validate(size_t size) const {
+      if(reinterpret_cast<uintptr_t>(base_) % alignof(wire::DeviceRecord) != 0) return false;
+      if(size < sizeof(wire::DeviceListHeader)) return false;
+
+      auto head = header();
+      if(head->magic != wire::DeviceListMagic || head->version != wire::DeviceListVersion || head->size != size) return false;
+      if(head->count > (size - sizeof(wire::DeviceListHeader)) / sizeof(wire::DeviceRecord)) return false;
+
+      auto inbounds = [size](const wire::StringRef &ref) {
+        return ref.offset % alignof(wchar_t) == 0 && ref.offset <= size && ref.length <= (size - ref.offset) / sizeof(wchar_t);
+      };
+
+      auto recs = reinterpret_cast<const wire::DeviceRecord*>(base_ + sizeof(wire::DeviceListHeader));
+      return std::all_of(recs, recs + head->count, [&](const wire::DeviceRecord &rec) {
+        return inbounds(rec.manufacturer) && inbounds(rec.model) && inbounds(rec.serial);
+      });
+    }
+
+    const char *base_;
+    bool valid_;
+  };
+
+  /**
+   * A device list message to be serialized, referencing devices owned by the caller
+   */
+  struct DeviceListUpdate {
+    struct Entry {
+      const vr::TrackedDevice *device;
+      uint32_t fields; // `wire::DeviceFields` to write for the device
+    };
+
+    uint32_t sequence;
+    bool keyframe;
+    std::vector<Entry> devices;
+  };
+
+  /**
+   * Writes a device list in the flat `wire` layout: header, fixed-size records, then string table
+   */
+  inline void serialize(OutMemStream& o, const DeviceListUpdate& update) {
+    size_t strings = sizeof(wire::DeviceListHeader) + update.devices.size() * sizeof(wire::DeviceRecord);
+    size_t offset = strings;
+
+    // Allocates a string table entry
+    auto ref = [&offset](const std::wstring &str) {
+      wire::StringRef ref{ static_cast<uint32_t>(offset), static_cast<uint32_t>(str.length()) };
+      offset += str.length() * sizeof(wchar_t);
+      return ref;
+    };
+
+    // Size of the message is known before writing anything
+    size_t total = strings;
+    for(auto &[dev, fields]: update.devices) {
+      if(fields & wire::Info)
+        total += (dev->manufacturer.length() + dev->model.length() + dev->serial.length()) * sizeof(wchar_t);
+    }
+
+    wire::DeviceListHeader header{
+      wire::DeviceListMagic, wire::DeviceListVersion,
+      static_cast<uint32_t>(update.devices.size()), static_cast<uint32_t>(total),
+      update.sequence, update.keyframe ? wire::Keyframe : wire::Delta
+    };
+    o.write(&header, sizeof(header));
+
+    for(auto &[dev, fields]: update.devices) {
+      wire::DeviceRecord rec{};
+      rec.slot = dev->slot;
+      rec.fields = fields;
+
+      if(fields & wire::Info) {
+        rec.type = dev->type;
+
+        if(dev->role) {
+          rec.flags |= wire::HasRole;
+          rec.role = dev->role.value();
+        }
+
+        if(dev->trackingStyle) {
+          rec.flags |= wire::HasTrackingStyle;
+          rec.trackingStyle = dev->trackingStyle.value();
+        }
+
+        rec.manufacturer = ref(dev->manufacturer);
+        rec.model = ref(dev->model);
+        rec.serial = ref(dev->serial);
+      }
+
+      if((fields & wire::Status) && dev->connected) {
+        rec.flags |= wire::Connected;
+      }
+
+      if((fields & wire::Pose) && dev->pose) {
+        auto &pose = dev->pose.value();
+        rec.flags |= wire::HasPose | (pose.valid ? wire::PoseValid : 0);
+        rec.result = pose.result;
+        for(int i = 0; i < 16; i++)
+          rec.matrix[i] = pose.matrix[i];
+        for(int i = 0; i < 3; i++) {
+          rec.velocity[i] = pose.velocity[i];
+          rec.angular[i] = pose.angular[i];
+        }
+      }
+
+      o.write(&rec, sizeof(rec));
+    }
+
+    for(auto &[dev, fields]: update.devices) {
+      if(!(fields & wire::Info)) continue;
+      o.write(dev->manufacturer.data(), dev->manufacturer.length() * sizeof(wchar_t));
+      o.write(dev->model.data(), dev->model.length() * sizeof(wchar_t));
+      o.write(dev->serial.data(), dev->serial.length() * sizeof(wchar_t));
+    }
   }
 
   template<class T>
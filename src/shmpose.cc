@@ -0,0 +1,238 @@
+/*
+ * This file is part of ovrly (https://github.com/joshperry/ovrly)
+ * Copyright (c) 2020 Joshua Perry
+ *
+ * This program can be redistributed and/or modified under the
+ * terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ */
+#include "platform.h"
+#include "shmpose.h"
+
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+
+#ifndef OS_WIN
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "logging.h"
+
+namespace ovrly{ namespace shm{
+
+// Module local
+namespace {
+  // Block names are suffixed with the browser process id, so separate instances don't share one
+#ifdef OS_WIN
+  const char* SHM_NAME = "Local\\ovrly-poses-";
+#else
+  const char* SHM_NAME = "/ovrly-poses-";
+#endif
+
+  // Times a read retries a record being written before giving up on it for now
+  constexpr int MaxReadAttempts = 64;
+
+  uint64_t processId() {
+#ifdef OS_WIN
+    return GetCurrentProcessId();
+#else
+    return getpid();
+#endif
+  }
+}
+
+/**
+ * Platform wrapper around a named shared memory mapping
+ */
+class Mapping {
+  public:
+    ~Mapping() {
+#ifdef OS_WIN
+      if(addr_) UnmapViewOfFile(addr_);
+      if(handle_) CloseHandle(handle_);
+#else
+      if(addr_) munmap(addr_, size_);
+      if(owner_) shm_unlink(name_.c_str());
+#endif
+    }
+
+    // Creates (or truncates) the named block for writing
+    static std::unique_ptr<Mapping> create(const std::string &name, size_t size) {
+      auto map = std::unique_ptr<Mapping>(new Mapping(name, size, true));
+#ifdef OS_WIN
+      map->handle_ = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(size), name.c_str());
+      if(!map->handle_) return nullptr;
+      map->addr_ = MapViewOfFile(map->handle_, FILE_MAP_WRITE, 0, 0, size);
+#else
+      int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+      if(fd < 0) return nullptr;
+      if(ftruncate(fd, size) != 0) {
+        close(fd);
+        return nullptr;
+      }
+      map->addr_ = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      close(fd);
+      if(map->addr_ == MAP_FAILED) map->addr_ = nullptr;
+#endif
+      return map->addr_ ? std::move(map) : nullptr;
+    }
+
+    // Maps an existing named block read-only
+    static std::unique_ptr<Mapping> open(const std::string &name, size_t size) {
+      auto map = std::unique_ptr<Mapping>(new Mapping(name, size, false));
+#ifdef OS_WIN
+      map->handle_ = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+      if(!map->handle_) return nullptr;
+      map->addr_ = MapViewOfFile(map->handle_, FILE_MAP_READ, 0, 0, size);
+#else
+      int fd = shm_open(name.c_str(), O_RDONLY, 0);
+      if(fd < 0) return nullptr;
+      map->addr_ = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+      close(fd);
+      if(map->addr_ == MAP_FAILED) map->addr_ = nullptr;
+#endif
+      return map->addr_ ? std::move(map) : nullptr;
+    }
+
+    void *addr() const { return addr_; }
+
+  private:
+    Mapping(const std::string &name, size_t size, bool owner) : name_(name), size_(size), owner_(owner) {}
+
+    std::string name_;
+    size_t size_;
+    bool owner_;
+    void *addr_{ nullptr };
+#ifdef OS_WIN
+    HANDLE handle_{ nullptr };
+#endif
+};
+
+
+/*
+ * Module exports
+ */
+
+std::string PoseWriter::Name() {
+  return SHM_NAME + std::to_string(processId());
+}
+
+std::unique_ptr<PoseWriter> PoseWriter::Create() {
+  auto mapping = Mapping::create(Name(), sizeof(PoseBlock));
+  if(!mapping) {
+    logger::error("(shm) Unable to create shared pose block");
+    return nullptr;
+  }
+
+  return std::unique_ptr<PoseWriter>(new PoseWriter(std::move(mapping)));
+}
+
+PoseWriter::PoseWriter(std::unique_ptr<Mapping> mapping) :
+  mapping_(std::move(mapping)),
+  block_(new(mapping_->addr()) PoseBlock{})
+{
+  block_->version = PoseBlockVersion;
+  block_->count = ::vr::k_unMaxTrackedDeviceCount;
+}
+
+PoseWriter::~PoseWriter() { }
+
+PoseRecord *PoseWriter::begin() {
+  // An odd sequence tells readers a write is in progress
+  block_->seq.store(block_->seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  return block_->slots;
+}
+
+void PoseWriter::commit() {
+  block_->frame.store(block_->frame.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  // Even again, readers that overlapped the write will retry
+  block_->seq.store(block_->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+std::unique_ptr<PoseReader> PoseReader::Open(const std::string &name) {
+  auto mapping = Mapping::open(name, sizeof(PoseBlock));
+  if(!mapping) {
+    return nullptr;
+  }
+
+  auto block = static_cast<const PoseBlock*>(mapping->addr());
+  if(block->version != PoseBlockVersion || block->count != ::vr::k_unMaxTrackedDeviceCount) {
+    logger::error("(shm) Shared pose block layout mismatch (version {})", block->version);
+    return nullptr;
+  }
+
+  return std::unique_ptr<PoseReader>(new PoseReader(std::move(mapping)));
+}
+
+PoseReader::PoseReader(std::unique_ptr<Mapping> mapping) :
+  mapping_(std::move(mapping)),
+  block_(static_cast<const PoseBlock*>(mapping_->addr()))
+{ }
+
+PoseReader::~PoseReader() { }
+
+void extrapolate(const float matrix[16], const float velocity[3], const float angular[3], float dt, float out[16]) {
+  memcpy(out, matrix, sizeof(float) * 16);
+
+  // Translation moves along the linear velocity
+  for(int i = 0; i < 3; i++) {
+    out[12 + i] += velocity[i] * dt;
+  }
+
+  // Rotation turns about the angular velocity axis, which is in tracking space
+  float speed = std::sqrt(angular[0] * angular[0] + angular[1] * angular[1] + angular[2] * angular[2]);
+  float theta = speed * dt;
+  if(speed < 1e-6f || theta == 0) {
+    return;
+  }
+
+  float x = angular[0] / speed, y = angular[1] / speed, z = angular[2] / speed;
+  float c = std::cos(theta), s = std::sin(theta), t = 1 - c;
+
+  // Rodrigues rotation, row-major
+  float rot[3][3] = {
+    { t*x*x + c, t*x*y - s*z, t*x*z + s*y },
+    { t*x*y + s*z, t*y*y + c, t*y*z - s*x },
+    { t*x*z - s*y, t*y*z + s*x, t*z*z + c },
+  };
+
+  // Pre-multiply the rotation part of each column
+  for(int col = 0; col < 3; col++) {
+    const float *src = &matrix[col * 4];
+    for(int row = 0; row < 3; row++) {
+      out[col * 4 + row] = rot[row][0] * src[0] + rot[row][1] * src[1] + rot[row][2] * src[2];
+    }
+  }
+}
+
+uint64_t PoseReader::read(unsigned slot, PoseRecord &out) const {
+  // Copied aside so `out` keeps the last consistent record if every attempt overlaps a write
+  PoseRecord record;
+  for(int attempt = 0; attempt < MaxReadAttempts; attempt++) {
+    auto seq = block_->seq.load(std::memory_order_acquire);
+    if(!(seq & 1)) {
+      auto frame = block_->frame.load(std::memory_order_relaxed);
+      memcpy(&record, &block_->slots[slot], sizeof(PoseRecord));
+
+      // Order the copy before re-checking the sequence
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if(block_->seq.load(std::memory_order_relaxed) == seq) {
+        out = record;
+        return frame;
+      }
+    }
+
+    // Writer is mid-update, let it finish rather than spinning on the core it may need
+    std::this_thread::yield();
+  }
+
+  return 0;
+}
+
+}} // module exports
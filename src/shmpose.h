@@ -0,0 +1,146 @@
+/*
+ * This file is part of ovrly (https://github.com/joshperry/ovrly)
+ * Copyright (c) 2020 Joshua Perry
+ *
+ * This program can be redistributed and/or modified under the
+ * terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "openvr.h"
+
+/**
+ * The purpose of this module is to share tracked device poses from the VR
+ * thread in the browser process with the render processes at display rate.
+ *
+ * Poses are written into a fixed-layout block of shared memory, indexed by
+ * device slot and guarded by a seqlock. Readers get a consistent view of a
+ * pose without making a syscall, taking a lock, or allocating, and the writer
+ * is never blocked by slow readers.
+ *
+ * Lower-rate state (device properties, connection changes) still travels over
+ * the zmq pubsub channel in `jsovrly`.
+ */
+
+namespace ovrly{ namespace shm{
+
+  /** Bumped whenever the layout of `PoseBlock` changes */
+  constexpr uint32_t PoseBlockVersion = 3;
+
+  /** Command line switch render processes get the browser process's block name in */
+  constexpr const char *PoseBlockSwitch = "ovrly-pose-block";
+
+  /**
+   * A device pose as laid out in shared memory
+   */
+  struct PoseRecord {
+    float matrix[16]; // Column-major device-to-standing transform, same layout as `mathfu::mat4`
+    float predicted[16]; // `matrix` as predicted by the runtime for when the frame's photons are displayed
+    float velocity[3]; // Meters/second in tracking space
+    float angular[3]; // Radians/second in tracking space
+    float photons; // Seconds from when the pose was sampled to when `predicted` is for, 0 when not predicting
+    int32_t result; // `::vr::ETrackingResult`
+    uint8_t valid;
+    uint8_t connected;
+    uint8_t pad[2];
+    uint64_t frame; // Frame the record last changed in, records are only rewritten when their device changes
+  };
+
+  /**
+   * The layout of the shared memory block
+   *
+   * Only the process creating the block writes to it, all others map it read-only.
+   */
+  struct PoseBlock {
+    uint32_t version; // `PoseBlockVersion` of the writer
+    uint32_t count; // Number of slots, always `k_unMaxTrackedDeviceCount`
+    std::atomic<uint32_t> seq; // Seqlock sequence, odd while a write is in progress
+    uint32_t pad;
+    std::atomic<uint64_t> frame; // Count of completed publishes
+    PoseRecord slots[::vr::k_unMaxTrackedDeviceCount];
+  };
+
+  static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+    "Shared memory atomics must be lock-free to be address-free across processes");
+
+  class Mapping;
+
+  /**
+   * Extrapolates a column-major device transform `dt` seconds ahead with the
+   * device's linear and angular velocity, writing the result to `out`
+   */
+  void extrapolate(const float matrix[16], const float velocity[3], const float angular[3], float dt, float out[16]);
+
+  /**
+   * Owns the shared pose block and publishes poses into it
+   *
+   * Must only be used from a single thread.
+   */
+  class PoseWriter {
+    public:
+      /** Creates the shared block, returns null if it could not be created */
+      static std::unique_ptr<PoseWriter> Create();
+
+      /** The name of the block this process creates, for the processes reading it */
+      static std::string Name();
+      ~PoseWriter();
+
+      /**
+       * Opens a write section and gets the slot-indexed records to update in place
+       *
+       * Records keep the values from the previous publish, so only those that
+       * changed need to be written.
+       */
+      PoseRecord *begin();
+
+      /** The frame the open write section will be published as */
+      uint64_t frame() const {
+        return block_->frame.load(std::memory_order_relaxed) + 1;
+      }
+
+      /** Closes the write section, making the updated records visible to readers */
+      void commit();
+
+    private:
+      PoseWriter(std::unique_ptr<Mapping> mapping);
+
+      std::unique_ptr<Mapping> mapping_;
+      PoseBlock *block_;
+  };
+
+  /**
+   * Maps the shared pose block read-only to get consistent pose records from it
+   */
+  class PoseReader {
+    public:
+      /** Maps the existing block `name`, returns null if none exists or its layout is incompatible */
+      static std::unique_ptr<PoseReader> Open(const std::string &name);
+      ~PoseReader();
+
+      /** The frame count of the most recent publish, for cheaply detecting changes */
+      uint64_t frame() const {
+        return block_->frame.load(std::memory_order_acquire);
+      }
+
+      /**
+       * Copies a consistent snapshot of the pose in `slot` into `out`
+       *
+       * Returns the frame the pose was published in, or 0 leaving `out` as it
+       * was when the writer kept overlapping the read.
+       */
+      uint64_t read(unsigned slot, PoseRecord &out) const;
+
+    private:
+      PoseReader(std::unique_ptr<Mapping> mapping);
+
+      std::unique_ptr<Mapping> mapping_;
+      const PoseBlock *block_;
+  };
+
+}} // namespaces
@@ -0,0 +1,285 @@
+/*
+ * This file is part of ovrly (https://github.com/joshperry/ovrly)
+ * Copyright (c) 2020 Joshua Perry
+ *
+ * This program can be redistributed and/or modified under the
+ * terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * The subset of the OpenVR API that ovrly uses, implemented by the headless
+ * stand-in runtime in this directory.
+ *
+ * When building with `OVRLY_OPENVR_STANDIN`, this header takes the place of
+ * OpenVR's, and the stand-in `openvr_api` library takes the place of
+ * OpenVR's. Types and enum values match OpenVR's so recorded data reads the
+ * same, but the interfaces only declare what ovrly calls, so the library is
+ * only compatible with code built against this header.
+ *
+ * Anything ovrly starts using from OpenVR has to be added here and in
+ * `runtime.cc` too.
+ */
+
+#if defined(_WIN32)
+  #if defined(VR_API_EXPORT)
+    #define VR_INTERFACE __declspec(dllexport)
+  #else
+    #define VR_INTERFACE __declspec(dllimport)
+  #endif
+#else
+  #define VR_INTERFACE __attribute__((visibility("default")))
+#endif
+
+namespace vr {
+
+  static const uint32_t k_unMaxTrackedDeviceCount = 64;
+  static const uint32_t k_unTrackedDeviceIndex_Hmd = 0;
+  static const uint32_t k_unTrackedDeviceIndexInvalid = 0xFFFFFFFF;
+  static const uint32_t k_unMaxPropertyStringSize = 32 * 1024;
+
+  typedef uint32_t TrackedDeviceIndex_t;
+  typedef uint64_t PropertyContainerHandle_t;
+  typedef uint64_t VROverlayHandle_t;
+
+  static const VROverlayHandle_t k_ulOverlayHandleInvalid = 0;
+
+  struct HmdMatrix34_t {
+    float m[3][4];
+  };
+
+  struct HmdVector3_t {
+    float v[3];
+  };
+
+  struct HmdQuad_t {
+    HmdVector3_t vCorners[4];
+  };
+
+  enum ETrackingResult {
+    TrackingResult_Uninitialized = 1,
+    TrackingResult_Calibrating_InProgress = 100,
+    TrackingResult_Calibrating_OutOfRange = 101,
+    TrackingResult_Running_OK = 200,
+    TrackingResult_Running_OutOfRange = 201,
+    TrackingResult_Fallback_RotationOnly = 300,
+  };
+
+  enum ETrackedDeviceClass {
+    TrackedDeviceClass_Invalid = 0,
+    TrackedDeviceClass_HMD = 1,
+    TrackedDeviceClass_Controller = 2,
+    TrackedDeviceClass_GenericTracker = 3,
+    TrackedDeviceClass_TrackingReference = 4,
+    TrackedDeviceClass_DisplayRedirect = 5,
+    TrackedDeviceClass_Max
+  };
+  typedef ETrackedDeviceClass TrackedDeviceClass;
+
+  enum ETrackedControllerRole {
+    TrackedControllerRole_Invalid = 0,
+    TrackedControllerRole_LeftHand = 1,
+    TrackedControllerRole_RightHand = 2,
+    TrackedControllerRole_OptOut = 3,
+    TrackedControllerRole_Treadmill = 4,
+    TrackedControllerRole_Stylus = 5,
+    TrackedControllerRole_Max = 5
+  };
+
+  enum EHmdTrackingStyle {
+    HmdTrackingStyle_Unknown = 0,
+    HmdTrackingStyle_Lighthouse = 1,
+    HmdTrackingStyle_OutsideInCameras = 2,
+    HmdTrackingStyle_InsideOutCameras = 3,
+  };
+
+  enum ETrackingUniverseOrigin {
+    TrackingUniverseSeated = 0,
+    TrackingUniverseStanding = 1,
+    TrackingUniverseRawAndUncalibrated = 2,
+  };
+
+  enum ETrackedDeviceProperty {
+    Prop_Invalid = 0,
+    Prop_TrackingSystemName_String = 1000,
+    Prop_ModelNumber_String = 1001,
+    Prop_SerialNumber_String = 1002,
+    Prop_ManufacturerName_String = 1005,
+    Prop_DeviceClass_Int32 = 1029,
+    Prop_ControllerRoleHint_Int32 = 1031,
+    Prop_SecondsFromVsyncToPhotons_Float = 2001,
+    Prop_DisplayFrequency_Float = 2002,
+    Prop_HmdTrackingStyle_Int32 = 2043,
+  };
+
+  enum ETrackedPropertyError {
+    TrackedProp_Success = 0,
+    TrackedProp_WrongDataType = 1,
+    TrackedProp_WrongDeviceClass = 2,
+    TrackedProp_BufferTooSmall = 3,
+    TrackedProp_UnknownProperty = 4,
+    TrackedProp_InvalidDevice = 5,
+    TrackedProp_ValueNotProvidedByDevice = 7,
+  };
+  typedef ETrackedPropertyError TrackedPropertyError;
+
+  struct TrackedDevicePose_t {
+    HmdMatrix34_t mDeviceToAbsoluteTracking;
+    HmdVector3_t vVelocity; // Meters/second in tracking space
+    HmdVector3_t vAngularVelocity; // Radians/second in tracking space
+    ETrackingResult eTrackingResult;
+    bool bPoseIsValid;
+    bool bDeviceIsConnected;
+  };
+
+  enum EVREventType {
+    VREvent_None = 0,
+    VREvent_TrackedDeviceActivated = 100,
+    VREvent_TrackedDeviceDeactivated = 101,
+    VREvent_TrackedDeviceUpdated = 102,
+    VREvent_TrackedDeviceUserInteractionStarted = 103,
+    VREvent_TrackedDeviceUserInteractionEnded = 104,
+    VREvent_TrackedDeviceRoleChanged = 108,
+    VREvent_PropertyChanged = 111,
+    VREvent_ButtonPress = 200,
+    VREvent_ButtonUnpress = 201,
+    VREvent_MouseMove = 300,
+    VREvent_MouseButtonDown = 301,
+    VREvent_MouseButtonUp = 302,
+    VREvent_Quit = 700,
+    VREvent_ChaperoneDataHasChanged = 800,
+    VREvent_ChaperoneUniverseHasChanged = 801,
+    VREvent_ActionBindingReloaded = 1604,
+    VREvent_VendorSpecific_Reserved_Start = 10000,
+    VREvent_VendorSpecific_Reserved_End = 19999,
+  };
+
+  struct VREvent_Property_t {
+    PropertyContainerHandle_t container;
+    ETrackedDeviceProperty prop;
+  };
+
+  union VREvent_Data_t {
+    VREvent_Property_t property;
+    uint64_t reserved[6];
+  };
+
+  struct VREvent_t {
+    uint32_t eventType; // `EVREventType`
+    TrackedDeviceIndex_t trackedDeviceIndex;
+    float eventAgeSeconds;
+    VREvent_Data_t data;
+  };
+
+  enum ETextureType {
+    TextureType_Invalid = -1,
+    TextureType_DirectX = 0,
+    TextureType_OpenGL = 1,
+    TextureType_Vulkan = 2,
+  };
+
+  enum EColorSpace {
+    ColorSpace_Auto = 0,
+    ColorSpace_Gamma = 1,
+    ColorSpace_Linear = 2,
+  };
+
+  struct Texture_t {
+    void *handle;
+    ETextureType eType;
+    EColorSpace eColorSpace;
+  };
+
+  struct VRTextureBounds_t {
+    float uMin, vMin;
+    float uMax, vMax;
+  };
+
+  enum EVROverlayError {
+    VROverlayError_None = 0,
+    VROverlayError_UnknownOverlay = 10,
+    VROverlayError_InvalidHandle = 11,
+    VROverlayError_KeyInUse = 17,
+    VROverlayError_InvalidParameter = 20,
+    VROverlayError_InvalidTexture = 24,
+  };
+
+  enum EVRInitError {
+    VRInitError_None = 0,
+    VRInitError_Unknown = 1,
+    VRInitError_Init_InterfaceNotFound = 105,
+    VRInitError_Init_InvalidInterface = 109,
+  };
+
+  enum EVRApplicationType {
+    VRApplication_Other = 0,
+    VRApplication_Scene = 1,
+    VRApplication_Overlay = 2,
+    VRApplication_Background = 3,
+  };
+
+  class IVRSystem {
+    public:
+      virtual void GetDeviceToAbsoluteTrackingPose(ETrackingUniverseOrigin eOrigin, float fPredictedSecondsToPhotonsFromNow, TrackedDevicePose_t *pTrackedDevicePoseArray, uint32_t unTrackedDevicePoseArrayCount) = 0;
+      virtual bool GetTimeSinceLastVsync(float *pfSecondsSinceLastVsync, uint64_t *pulFrameCounter) = 0;
+      virtual ETrackedControllerRole GetControllerRoleForTrackedDeviceIndex(TrackedDeviceIndex_t unDeviceIndex) = 0;
+      virtual ETrackedDeviceClass GetTrackedDeviceClass(TrackedDeviceIndex_t unDeviceIndex) = 0;
+      virtual bool IsTrackedDeviceConnected(TrackedDeviceIndex_t unDeviceIndex) = 0;
+      virtual float GetFloatTrackedDeviceProperty(TrackedDeviceIndex_t unDeviceIndex, ETrackedDeviceProperty prop, ETrackedPropertyError *pError = nullptr) = 0;
+      virtual int32_t GetInt32TrackedDeviceProperty(TrackedDeviceIndex_t unDeviceIndex, ETrackedDeviceProperty prop, ETrackedPropertyError *pError = nullptr) = 0;
+      virtual uint32_t GetStringTrackedDeviceProperty(TrackedDeviceIndex_t unDeviceIndex, ETrackedDeviceProperty prop, char *pchValue, uint32_t unBufferSize, ETrackedPropertyError *pError = nullptr) = 0;
+      virtual bool PollNextEvent(VREvent_t *pEvent, uint32_t uncbVREvent) = 0;
+      virtual const char *GetEventTypeNameFromEnum(EVREventType eType) = 0;
+
+    protected:
+      ~IVRSystem() {}
+  };
+
+  class IVROverlay {
+    public:
+      virtual EVROverlayError FindOverlay(const char *pchOverlayKey, VROverlayHandle_t *pOverlayHandle) = 0;
+      virtual EVROverlayError CreateOverlay(const char *pchOverlayKey, const char *pchOverlayName, VROverlayHandle_t *pOverlayHandle) = 0;
+      virtual EVROverlayError DestroyOverlay(VROverlayHandle_t ulOverlayHandle) = 0;
+      virtual EVROverlayError SetOverlayWidthInMeters(VROverlayHandle_t ulOverlayHandle, float fWidthInMeters) = 0;
+      virtual EVROverlayError SetOverlayTextureBounds(VROverlayHandle_t ulOverlayHandle, const VRTextureBounds_t *pOverlayTextureBounds) = 0;
+      virtual EVROverlayError SetOverlayTransformAbsolute(VROverlayHandle_t ulOverlayHandle, ETrackingUniverseOrigin eTrackingOrigin, const HmdMatrix34_t *pmatTrackingOriginToOverlayTransform) = 0;
+      virtual EVROverlayError GetOverlayTransformAbsolute(VROverlayHandle_t ulOverlayHandle, ETrackingUniverseOrigin *peTrackingOrigin, HmdMatrix34_t *pmatTrackingOriginToOverlayTransform) = 0;
+      virtual EVROverlayError ShowOverlay(VROverlayHandle_t ulOverlayHandle) = 0;
+      virtual EVROverlayError SetOverlayTexture(VROverlayHandle_t ulOverlayHandle, const Texture_t *pTexture) = 0;
+      virtual EVROverlayError SetOverlayFromFile(VROverlayHandle_t ulOverlayHandle, const char *pchFilePath) = 0;
+
+    protected:
+      ~IVROverlay() {}
+  };
+
+  class IVRChaperone {
+    public:
+      virtual bool GetPlayAreaRect(HmdQuad_t *rect) = 0;
+
+    protected:
+      ~IVRChaperone() {}
+  };
+
+  static const char * const IVRSystem_Version = "IVRSystem_022";
+  static const char * const IVROverlay_Version = "IVROverlay_027";
+  static const char * const IVRChaperone_Version = "IVRChaperone_004";
+
+  /** Starts the stand-in runtime, loading the script named by `OVRLY_STANDIN_SCRIPT` */
+  VR_INTERFACE IVRSystem *VR_Init(EVRInitError *peError, EVRApplicationType eApplicationType, const char *pStartupInfo = nullptr);
+
+  /** Stops the stand-in runtime, writing out its recording */
+  VR_INTERFACE void VR_Shutdown();
+
+  VR_INTERFACE const char *VR_GetVRInitErrorAsEnglishDescription(EVRInitError error);
+
+  VR_INTERFACE void *VR_GetGenericInterface(const char *pchInterfaceVersion, EVRInitError *peError);
+
+  VR_INTERFACE IVRSystem *VRSystem();
+  VR_INTERFACE IVROverlay *VROverlay();
+  VR_INTERFACE IVRChaperone *VRChaperone();
+
+} // namespace vr
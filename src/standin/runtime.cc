@@ -0,0 +1,552 @@
+/*
+ * This file is part of ovrly (https://github.com/joshperry/ovrly)
+ * Copyright (c) 2020 Joshua Perry
+ *
+ * This program can be redistributed and/or modified under the
+ * terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ */
+#include "openvr.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+#include "script.h"
+
+/**
+ * A headless stand-in for the OpenVR runtime, so ovrly can run and be
+ * benchmarked without SteamVR or a headset.
+ *
+ * Devices, their movements, and events come from the script named by the
+ * `OVRLY_STANDIN_SCRIPT` environment variable (see `script.h`), or a default
+ * one. Overlay operations are recorded to the file named by
+ * `OVRLY_STANDIN_RECORD` when it's set, one line per operation, with a
+ * summary written to stderr on `VR_Shutdown`.
+ */
+
+namespace ovrly{ namespace standin{
+
+// Module local
+namespace {
+  typedef std::chrono::steady_clock clock;
+
+  // Builds a row-major rotation from yaw about +y, pitch about +x, then roll about +z
+  void rotationMatrix(const float (&r)[3], float (&m)[3][4]) {
+    float cy = std::cos(r[0]), sy = std::sin(r[0]);
+    float cp = std::cos(r[1]), sp = std::sin(r[1]);
+    float cr = std::cos(r[2]), sr = std::sin(r[2]);
+
+    m[0][0] = cy * cr + sy * sp * sr; m[0][1] = -cy * sr + sy * sp * cr; m[0][2] = sy * cp;
+    m[1][0] = cp * sr;                m[1][1] = cp * cr;                 m[1][2] = -sp;
+    m[2][0] = -sy * cr + cy * sp * sr; m[2][1] = sy * sr + cy * sp * cr; m[2][2] = cy * cp;
+  }
+
+  /**
+   * Evaluates a device's trajectory at a time
+   *
+   * Angular velocity is taken as the rate of change of the yaw, pitch, and
+   * roll about their axes, which is close enough for scripted motion.
+   */
+  void evaluate(const ScriptedDevice &dev, double time, vr::TrackedDevicePose_t &out) {
+    float position[3] = { 0, 0, 0 }, rotation[3] = { 0, 0, 0 };
+    float velocity[3] = { 0, 0, 0 }, angular[3] = { 0, 0, 0 };
+
+    auto &keys = dev.keyframes;
+    if(!keys.empty()) {
+      // First keyframe after `time`
+      size_t next = 0;
+      while(next < keys.size() && keys[next].time <= time) ++next;
+
+      if(next == 0 || next == keys.size()) {
+        // Holding still before the first or after the last
+        auto &key = next == 0 ? keys.front() : keys.back();
+        std::copy(std::begin(key.position), std::end(key.position), position);
+        std::copy(std::begin(key.rotation), std::end(key.rotation), rotation);
+      } else {
+        auto &a = keys[next - 1], &b = keys[next];
+        float span = static_cast<float>(b.time - a.time);
+        float t = static_cast<float>(time - a.time) / span;
+        for(int i = 0; i < 3; i++) {
+          position[i] = a.position[i] + (b.position[i] - a.position[i]) * t;
+          rotation[i] = a.rotation[i] + (b.rotation[i] - a.rotation[i]) * t;
+          velocity[i] = (b.position[i] - a.position[i]) / span;
+        }
+        angular[0] = (b.rotation[1] - a.rotation[1]) / span; // Pitch about x
+        angular[1] = (b.rotation[0] - a.rotation[0]) / span; // Yaw about y
+        angular[2] = (b.rotation[2] - a.rotation[2]) / span; // Roll about z
+      }
+    }
+
+    rotationMatrix(rotation, out.mDeviceToAbsoluteTracking.m);
+    for(int i = 0; i < 3; i++) {
+      out.mDeviceToAbsoluteTracking.m[i][3] = position[i];
+      out.vVelocity.v[i] = velocity[i];
+      out.vAngularVelocity.v[i] = angular[i];
+    }
+    out.eTrackingResult = vr::TrackingResult_Running_OK;
+    out.bPoseIsValid = true;
+  }
+
+  // What's known about an overlay
+  struct Overlay {
+    std::string key;
+    float width{ 1 };
+    bool visible{ false };
+    vr::HmdMatrix34_t transform{ { {1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0} } };
+    vr::VRTextureBounds_t bounds{ 0, 0, 1, 1 };
+
+    // Texture submission stats
+    uint64_t submits{ 0 };
+    double firstsubmit{ 0 };
+    double lastsubmit{ 0 };
+    uint64_t transforms{ 0 };
+  };
+
+  /**
+   * The stand-in runtime, implementing each interface ovrly gets from OpenVR
+   *
+   * ovrly calls into it from several threads, so all state is behind one lock.
+   */
+  class Runtime : public vr::IVRSystem, public vr::IVROverlay, public vr::IVRChaperone {
+    public:
+      Runtime(Script script) : script_(std::move(script)), start_(clock::now()) {
+        for(unsigned slot = 0; slot < vr::k_unMaxTrackedDeviceCount; slot++) {
+          auto &dev = script_.devices[slot];
+          active_[slot] = dev && dev->activate <= 0;
+          connected_[slot] = active_[slot];
+        }
+
+        if(auto path = std::getenv("OVRLY_STANDIN_RECORD")) {
+          record_.open(path);
+          if(!record_) {
+            std::fprintf(stderr, "(standin) Unable to open recording file %s\n", path);
+          }
+        }
+      }
+
+      ~Runtime() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(auto &[handle, overlay]: overlays_) {
+          double span = overlay.lastsubmit - overlay.firstsubmit;
+          std::fprintf(stderr, "(standin) overlay %s: %llu textures submitted (%.1f/s), %llu transforms set\n",
+            overlay.key.c_str(), static_cast<unsigned long long>(overlay.submits),
+            overlay.submits > 1 && span > 0 ? (overlay.submits - 1) / span : 0.0,
+            static_cast<unsigned long long>(overlay.transforms));
+        }
+      }
+
+      /*
+       * IVRSystem
+       */
+
+      // Scripted poses are all standing-universe, `eOrigin` isn't applied
+      void GetDeviceToAbsoluteTrackingPose(vr::ETrackingUniverseOrigin eOrigin, float fPredictedSecondsToPhotonsFromNow, vr::TrackedDevicePose_t *pTrackedDevicePoseArray, uint32_t unTrackedDevicePoseArrayCount) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        double time = trajectoryTime(now() + fPredictedSecondsToPhotonsFromNow);
+
+        for(uint32_t slot = 0; slot < unTrackedDevicePoseArrayCount && slot < vr::k_unMaxTrackedDeviceCount; slot++) {
+          auto &pose = pTrackedDevicePoseArray[slot];
+          pose = {};
+          if(!active_[slot]) {
+            pose.eTrackingResult = vr::TrackingResult_Uninitialized;
+            continue;
+          }
+
+          pose.bDeviceIsConnected = connected_[slot];
+          if(connected_[slot]) {
+            evaluate(*script_.devices[slot], time, pose);
+          } else {
+            pose.eTrackingResult = vr::TrackingResult_Running_OutOfRange;
+          }
+        }
+      }
+
+      bool GetTimeSinceLastVsync(float *pfSecondsSinceLastVsync, uint64_t *pulFrameCounter) override {
+        double elapsed = now();
+        double period = 1.0 / script_.frequency;
+        auto frame = static_cast<uint64_t>(elapsed / period);
+
+        if(pfSecondsSinceLastVsync) *pfSecondsSinceLastVsync = static_cast<float>(elapsed - frame * period);
+        if(pulFrameCounter) *pulFrameCounter = frame;
+        return true;
+      }
+
+      vr::ETrackedControllerRole GetControllerRoleForTrackedDeviceIndex(vr::TrackedDeviceIndex_t unDeviceIndex) override {
+        vr::ETrackedPropertyError err;
+        auto role = GetInt32TrackedDeviceProperty(unDeviceIndex, vr::Prop_ControllerRoleHint_Int32, &err);
+        return err == vr::TrackedProp_Success ? static_cast<vr::ETrackedControllerRole>(role) : vr::TrackedControllerRole_Invalid;
+      }
+
+      vr::ETrackedDeviceClass GetTrackedDeviceClass(vr::TrackedDeviceIndex_t unDeviceIndex) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return isActive(unDeviceIndex) ? script_.devices[unDeviceIndex]->type : vr::TrackedDeviceClass_Invalid;
+      }
+
+      bool IsTrackedDeviceConnected(vr::TrackedDeviceIndex_t unDeviceIndex) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return isActive(unDeviceIndex) && connected_[unDeviceIndex];
+      }
+
+      float GetFloatTrackedDeviceProperty(vr::TrackedDeviceIndex_t unDeviceIndex, vr::ETrackedDeviceProperty prop, vr::ETrackedPropertyError *pError) override {
+        auto value = property(unDeviceIndex, prop, pError);
+        return value ? std::strtof(value->c_str(), nullptr) : 0;
+      }
+
+      int32_t GetInt32TrackedDeviceProperty(vr::TrackedDeviceIndex_t unDeviceIndex, vr::ETrackedDeviceProperty prop, vr::ETrackedPropertyError *pError) override {
+        auto value = property(unDeviceIndex, prop, pError);
+        return value ? std::atoi(value->c_str()) : 0;
+      }
+
+      uint32_t GetStringTrackedDeviceProperty(vr::TrackedDeviceIndex_t unDeviceIndex, vr::ETrackedDeviceProperty prop, char *pchValue, uint32_t unBufferSize, vr::ETrackedPropertyError *pError) override {
+        auto value = property(unDeviceIndex, prop, pError);
+        if(!value) {
+          if(pchValue && unBufferSize) pchValue[0] = 0;
+          return 0;
+        }
+
+        // Like OpenVR, the size needed including the terminator is returned when the buffer is too small
+        uint32_t size = static_cast<uint32_t>(value->size() + 1);
+        if(!pchValue || size > unBufferSize) {
+          if(pError) *pError = vr::TrackedProp_BufferTooSmall;
+          return size;
+        }
+        std::memcpy(pchValue, value->c_str(), size);
+        return size;
+      }
+
+      bool PollNextEvent(vr::VREvent_t *pEvent, uint32_t uncbVREvent) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        double time = now();
+
+        if(nextevent_ >= script_.events.size() || script_.events[nextevent_].time > time) {
+          return false;
+        }
+
+        auto &ev = script_.events[nextevent_];
+        // State changes happen as the first of an event's repeats is raised
+        if(raised_ == 0) {
+          apply(ev);
+        }
+
+        std::memcpy(pEvent, &ev.event, std::min<size_t>(uncbVREvent, sizeof(vr::VREvent_t)));
+        pEvent->eventAgeSeconds = static_cast<float>(time - ev.time);
+
+        if(++raised_ >= ev.count) {
+          raised_ = 0;
+          ++nextevent_;
+        }
+        return true;
+      }
+
+      const char *GetEventTypeNameFromEnum(vr::EVREventType eType) override {
+        auto name = eventName(eType);
+        return name ? name : "Unknown";
+      }
+
+      /*
+       * IVROverlay
+       */
+
+      vr::EVROverlayError FindOverlay(const char *pchOverlayKey, vr::VROverlayHandle_t *pOverlayHandle) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(auto &[handle, overlay]: overlays_) {
+          if(overlay.key == pchOverlayKey) {
+            *pOverlayHandle = handle;
+            return vr::VROverlayError_None;
+          }
+        }
+        return vr::VROverlayError_UnknownOverlay;
+      }
+
+      vr::EVROverlayError CreateOverlay(const char *pchOverlayKey, const char *pchOverlayName, vr::VROverlayHandle_t *pOverlayHandle) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(auto &[handle, overlay]: overlays_) {
+          if(overlay.key == pchOverlayKey) {
+            return vr::VROverlayError_KeyInUse;
+          }
+        }
+
+        *pOverlayHandle = ++lasthandle_;
+        overlays_[*pOverlayHandle].key = pchOverlayKey;
+        record("create", *pOverlayHandle) << ' ' << pchOverlayKey << '\n';
+        return vr::VROverlayError_None;
+      }
+
+      vr::EVROverlayError DestroyOverlay(vr::VROverlayHandle_t ulOverlayHandle) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!overlays_.erase(ulOverlayHandle)) {
+          return vr::VROverlayError_InvalidHandle;
+        }
+        record("destroy", ulOverlayHandle) << '\n';
+        return vr::VROverlayError_None;
+      }
+
+      vr::EVROverlayError SetOverlayWidthInMeters(vr::VROverlayHandle_t ulOverlayHandle, float fWidthInMeters) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto overlay = find(ulOverlayHandle);
+        if(!overlay) return vr::VROverlayError_InvalidHandle;
+
+        overlay->width = fWidthInMeters;
+        record("width", ulOverlayHandle) << ' ' << fWidthInMeters << '\n';
+        return vr::VROverlayError_None;
+      }
+
+      vr::EVROverlayError SetOverlayTextureBounds(vr::VROverlayHandle_t ulOverlayHandle, const vr::VRTextureBounds_t *pOverlayTextureBounds) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto overlay = find(ulOverlayHandle);
+        if(!overlay) return vr::VROverlayError_InvalidHandle;
+
+        overlay->bounds = *pOverlayTextureBounds;
+        record("bounds", ulOverlayHandle) << ' ' << pOverlayTextureBounds->uMin << ' ' << pOverlayTextureBounds->vMin
+          << ' ' << pOverlayTextureBounds->uMax << ' ' << pOverlayTextureBounds->vMax << '\n';
+        return vr::VROverlayError_None;
+      }
+
+      // Transforms are recorded as standing-universe whatever `eTrackingOrigin` is, like the poses they're built from
+      vr::EVROverlayError SetOverlayTransformAbsolute(vr::VROverlayHandle_t ulOverlayHandle, vr::ETrackingUniverseOrigin eTrackingOrigin, const vr::HmdMatrix34_t *pmatTrackingOriginToOverlayTransform) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto overlay = find(ulOverlayHandle);
+        if(!overlay) return vr::VROverlayError_InvalidHandle;
+
+        overlay->transform = *pmatTrackingOriginToOverlayTransform;
+        ++overlay->transforms;
+
+        auto &out = record("transform", ulOverlayHandle);
+        for(auto &row: pmatTrackingOriginToOverlayTransform->m) {
+          for(auto v: row) out << ' ' << v;
+        }
+        out << '\n';
+        return vr::VROverlayError_None;
+      }
+
+      vr::EVROverlayError GetOverlayTransformAbsolute(vr::VROverlayHandle_t ulOverlayHandle, vr::ETrackingUniverseOrigin *peTrackingOrigin, vr::HmdMatrix34_t *pmatTrackingOriginToOverlayTransform) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto overlay = find(ulOverlayHandle);
+        if(!overlay) return vr::VROverlayError_InvalidHandle;
+
+        *peTrackingOrigin = vr::TrackingUniverseStanding;
+        *pmatTrackingOriginToOverlayTransform = overlay->transform;
+        return vr::VROverlayError_None;
+      }
+
+      vr::EVROverlayError ShowOverlay(vr::VROverlayHandle_t ulOverlayHandle) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto overlay = find(ulOverlayHandle);
+        if(!overlay) return vr::VROverlayError_InvalidHandle;
+
+        overlay->visible = true;
+        record("show", ulOverlayHandle) << '\n';
+        return vr::VROverlayError_None;
+      }
+
+      vr::EVROverlayError SetOverlayTexture(vr::VROverlayHandle_t ulOverlayHandle, const vr::Texture_t *pTexture) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto overlay = find(ulOverlayHandle);
+        if(!overlay) return vr::VROverlayError_InvalidHandle;
+        if(!pTexture || !pTexture->handle) return vr::VROverlayError_InvalidTexture;
+
+        double time = now();
+        if(!overlay->submits++) {
+          overlay->firstsubmit = time;
+        }
+        overlay->lastsubmit = time;
+
+        // Texture contents live in the app's graphics context, only the handle is recorded
+        record("texture", ulOverlayHandle) << ' ' << pTexture->handle << ' ' << pTexture->eType << '\n';
+        return vr::VROverlayError_None;
+      }
+
+      vr::EVROverlayError SetOverlayFromFile(vr::VROverlayHandle_t ulOverlayHandle, const char *pchFilePath) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!find(ulOverlayHandle)) return vr::VROverlayError_InvalidHandle;
+
+        record("file", ulOverlayHandle) << ' ' << pchFilePath << '\n';
+        return vr::VROverlayError_None;
+      }
+
+      /*
+       * IVRChaperone
+       */
+
+      bool GetPlayAreaRect(vr::HmdQuad_t *rect) override {
+        float x = script_.playarea[0] / 2, z = script_.playarea[1] / 2;
+        *rect = { { { { -x, 0, -z } }, { { x, 0, -z } }, { { x, 0, z } }, { { -x, 0, z } } } };
+        return true;
+      }
+
+    private:
+      // Seconds since the runtime was started
+      double now() const {
+        return std::chrono::duration<double>(clock::now() - start_).count();
+      }
+
+      // Wraps a time into the script's trajectory loop
+      double trajectoryTime(double time) const {
+        return script_.loop > 0 ? std::fmod(time, script_.loop) : time;
+      }
+
+      bool isActive(vr::TrackedDeviceIndex_t slot) const {
+        return slot < vr::k_unMaxTrackedDeviceCount && active_[slot];
+      }
+
+      // Gets a property's value as text, setting the error like OpenVR does
+      std::optional<std::string> property(vr::TrackedDeviceIndex_t slot, vr::ETrackedDeviceProperty prop, vr::ETrackedPropertyError *err) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!isActive(slot)) {
+          if(err) *err = vr::TrackedProp_InvalidDevice;
+          return std::nullopt;
+        }
+
+        auto &props = script_.devices[slot]->props;
+        auto value = props.find(prop);
+        if(value == props.end()) {
+          if(err) *err = vr::TrackedProp_ValueNotProvidedByDevice;
+          return std::nullopt;
+        }
+
+        if(err) *err = vr::TrackedProp_Success;
+        return value->second;
+      }
+
+      // Applies the state change a scripted event carries
+      void apply(const ScriptedEvent &ev) {
+        auto slot = ev.event.trackedDeviceIndex;
+        if(slot >= vr::k_unMaxTrackedDeviceCount || !script_.devices[slot]) {
+          return;
+        }
+
+        if(ev.value) {
+          script_.devices[slot]->props[ev.event.data.property.prop] = *ev.value;
+        }
+        if(ev.connected) {
+          connected_[slot] = *ev.connected;
+        }
+        if(ev.event.eventType == vr::VREvent_TrackedDeviceActivated) {
+          active_[slot] = true;
+          connected_[slot] = true;
+        }
+      }
+
+      Overlay *find(vr::VROverlayHandle_t handle) {
+        auto overlay = overlays_.find(handle);
+        return overlay != overlays_.end() ? &overlay->second : nullptr;
+      }
+
+      // Starts a line in the recording, the caller finishes it
+      std::ostream &record(const char *op, vr::VROverlayHandle_t handle) {
+        static std::ofstream discard;
+        auto &out = record_.is_open() ? record_ : discard;
+        out << now() << ' ' << op << ' ' << handle;
+        return out;
+      }
+
+      std::mutex mutex_;
+      Script script_;
+      clock::time_point start_;
+
+      bool active_[vr::k_unMaxTrackedDeviceCount]; // Whether a device has appeared in each slot
+      bool connected_[vr::k_unMaxTrackedDeviceCount];
+
+      size_t nextevent_{ 0 }; // Index of the next scripted event to raise
+      uint32_t raised_{ 0 }; // Repeats of the next event raised so far
+
+      std::map<vr::VROverlayHandle_t, Overlay> overlays_;
+      vr::VROverlayHandle_t lasthandle_{ 0 };
+
+      std::ofstream record_;
+  };
+
+  std::unique_ptr<Runtime> runtime_;
+
+  // Loads the script the environment names, or the default one
+  Script startupScript() {
+    auto path = std::getenv("OVRLY_STANDIN_SCRIPT");
+    if(!path) {
+      return defaultScript();
+    }
+
+    std::ifstream in(path);
+    if(!in) {
+      throw std::runtime_error(std::string("unable to open ") + path);
+    }
+    return loadScript(in);
+  }
+}
+
+}} // namespaces
+
+
+/*
+ * OpenVR entry points
+ */
+
+namespace vr {
+
+using ovrly::standin::runtime_;
+
+IVRSystem *VR_Init(EVRInitError *peError, EVRApplicationType eApplicationType, const char *pStartupInfo) {
+  try {
+    runtime_ = std::make_unique<ovrly::standin::Runtime>(ovrly::standin::startupScript());
+  } catch(std::exception &err) {
+    std::fprintf(stderr, "(standin) Failed to load script: %s\n", err.what());
+    if(peError) *peError = VRInitError_Unknown;
+    return nullptr;
+  }
+
+  if(peError) *peError = VRInitError_None;
+  return runtime_.get();
+}
+
+void VR_Shutdown() {
+  runtime_.reset();
+}
+
+const char *VR_GetVRInitErrorAsEnglishDescription(EVRInitError error) {
+  switch(error) {
+    case VRInitError_None: return "No Error (0)";
+    case VRInitError_Init_InterfaceNotFound: return "Interface not found (105)";
+    case VRInitError_Init_InvalidInterface: return "Invalid interface (109)";
+    default: return "Stand-in runtime failed to start, check its script";
+  }
+}
+
+void *VR_GetGenericInterface(const char *pchInterfaceVersion, EVRInitError *peError) {
+  void *iface = nullptr;
+  if(runtime_) {
+    if(std::strcmp(pchInterfaceVersion, IVRSystem_Version) == 0) {
+      iface = static_cast<IVRSystem*>(runtime_.get());
+    } else if(std::strcmp(pchInterfaceVersion, IVROverlay_Version) == 0) {
+      iface = static_cast<IVROverlay*>(runtime_.get());
+    } else if(std::strcmp(pchInterfaceVersion, IVRChaperone_Version) == 0) {
+      iface = static_cast<IVRChaperone*>(runtime_.get());
+    }
+  }
+
+  if(peError) *peError = iface ? VRInitError_None : VRInitError_Init_InterfaceNotFound;
+  return iface;
+}
+
+IVRSystem *VRSystem() {
+  return runtime_.get();
+}
+
+IVROverlay *VROverlay() {
+  return runtime_.get();
+}
+
+IVRChaperone *VRChaperone() {
+  return runtime_.get();
+}
+
+} // namespace vr
@@ -0,0 +1,309 @@
+/*
+ * This file is part of ovrly (https://github.com/joshperry/ovrly)
+ * Copyright (c) 2020 Joshua Perry
+ *
+ * This program can be redistributed and/or modified under the
+ * terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ */
+#include "script.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace ovrly{ namespace standin{
+
+// Module local
+namespace {
+  const float DEG2RAD = 3.14159265358979f / 180;
+
+  // Map from script name to event type
+  std::map<std::string, vr::EVREventType> eventmap = {
+    {"TrackedDeviceActivated", vr::VREvent_TrackedDeviceActivated},
+    {"TrackedDeviceDeactivated", vr::VREvent_TrackedDeviceDeactivated},
+    {"TrackedDeviceUpdated", vr::VREvent_TrackedDeviceUpdated},
+    {"TrackedDeviceUserInteractionStarted", vr::VREvent_TrackedDeviceUserInteractionStarted},
+    {"TrackedDeviceUserInteractionEnded", vr::VREvent_TrackedDeviceUserInteractionEnded},
+    {"TrackedDeviceRoleChanged", vr::VREvent_TrackedDeviceRoleChanged},
+    {"PropertyChanged", vr::VREvent_PropertyChanged},
+    {"ButtonPress", vr::VREvent_ButtonPress},
+    {"ButtonUnpress", vr::VREvent_ButtonUnpress},
+    {"MouseMove", vr::VREvent_MouseMove},
+    {"MouseButtonDown", vr::VREvent_MouseButtonDown},
+    {"MouseButtonUp", vr::VREvent_MouseButtonUp},
+    {"Quit", vr::VREvent_Quit},
+    {"ChaperoneDataHasChanged", vr::VREvent_ChaperoneDataHasChanged},
+    {"ChaperoneUniverseHasChanged", vr::VREvent_ChaperoneUniverseHasChanged},
+    {"ActionBindingReloaded", vr::VREvent_ActionBindingReloaded},
+  };
+
+  // Map from script name to device property
+  std::map<std::string, vr::ETrackedDeviceProperty> propmap = {
+    {"TrackingSystemName", vr::Prop_TrackingSystemName_String},
+    {"ModelNumber", vr::Prop_ModelNumber_String},
+    {"SerialNumber", vr::Prop_SerialNumber_String},
+    {"ManufacturerName", vr::Prop_ManufacturerName_String},
+    {"DeviceClass", vr::Prop_DeviceClass_Int32},
+    {"ControllerRoleHint", vr::Prop_ControllerRoleHint_Int32},
+    {"SecondsFromVsyncToPhotons", vr::Prop_SecondsFromVsyncToPhotons_Float},
+    {"DisplayFrequency", vr::Prop_DisplayFrequency_Float},
+    {"HmdTrackingStyle", vr::Prop_HmdTrackingStyle_Int32},
+  };
+
+  // Map from script name to device class
+  std::map<std::string, vr::ETrackedDeviceClass> classmap = {
+    {"hmd", vr::TrackedDeviceClass_HMD},
+    {"controller", vr::TrackedDeviceClass_Controller},
+    {"tracker", vr::TrackedDeviceClass_GenericTracker},
+    {"reference", vr::TrackedDeviceClass_TrackingReference},
+  };
+
+  // Map from script name to controller role, same names as `vrovrly`
+  std::map<std::string, vr::ETrackedControllerRole> rolemap = {
+    {"left", vr::TrackedControllerRole_LeftHand},
+    {"right", vr::TrackedControllerRole_RightHand},
+    {"optout", vr::TrackedControllerRole_OptOut},
+    {"treadmill", vr::TrackedControllerRole_Treadmill},
+    {"stylus", vr::TrackedControllerRole_Stylus},
+  };
+
+  // Map from script name to tracking style, same names as `vrovrly`
+  std::map<std::string, vr::EHmdTrackingStyle> stylemap = {
+    {"lighthouse", vr::HmdTrackingStyle_Lighthouse},
+    {"outside-in", vr::HmdTrackingStyle_OutsideInCameras},
+    {"inside-out", vr::HmdTrackingStyle_InsideOutCameras},
+  };
+
+  // Looks a script name up in one of the maps
+  template<typename T>
+  T lookup(const std::map<std::string, T> &map, const std::string &name, const char *what) {
+    auto it = map.find(name);
+    if(it == map.end()) {
+      throw std::runtime_error("unknown " + std::string(what) + " '" + name + "'");
+    }
+    return it->second;
+  }
+
+  // Reads the next field of a line, failing if there isn't one
+  template<typename T>
+  T field(std::istream &in, const char *what) {
+    T value;
+    if(!(in >> value)) {
+      throw std::runtime_error(std::string("expected ") + what);
+    }
+    return value;
+  }
+
+  // Reads the next field of a line as a possibly quoted string
+  std::string text(std::istream &in, const char *what) {
+    std::string value;
+    if(!(in >> std::quoted(value))) {
+      throw std::runtime_error(std::string("expected ") + what);
+    }
+    return value;
+  }
+
+  unsigned slotField(std::istream &in) {
+    auto slot = field<unsigned>(in, "slot");
+    if(slot >= vr::k_unMaxTrackedDeviceCount) {
+      throw std::runtime_error("slot out of range");
+    }
+    return slot;
+  }
+
+  // Gets a device a command refers to, which has to be declared before it
+  ScriptedDevice &scriptedDevice(Script &script, unsigned slot) {
+    if(!script.devices[slot]) {
+      throw std::runtime_error("no device in slot " + std::to_string(slot));
+    }
+    return *script.devices[slot];
+  }
+
+  void parseDevice(Script &script, std::istream &in) {
+    auto slot = slotField(in);
+
+    ScriptedDevice dev;
+    dev.type = lookup(classmap, field<std::string>(in, "device class"), "device class");
+    dev.props[vr::Prop_ManufacturerName_String] = text(in, "manufacturer");
+    dev.props[vr::Prop_ModelNumber_String] = text(in, "model");
+    dev.props[vr::Prop_SerialNumber_String] = text(in, "serial");
+    dev.props[vr::Prop_DeviceClass_Int32] = std::to_string(dev.type);
+
+    // Optional key=value settings
+    std::string option;
+    while(in >> option) {
+      auto eq = option.find('=');
+      auto key = option.substr(0, eq);
+      auto value = eq == std::string::npos ? std::string() : option.substr(eq + 1);
+
+      if(key == "role") {
+        dev.props[vr::Prop_ControllerRoleHint_Int32] = std::to_string(lookup(rolemap, value, "role"));
+      } else if(key == "style") {
+        dev.props[vr::Prop_HmdTrackingStyle_Int32] = std::to_string(lookup(stylemap, value, "tracking style"));
+      } else if(key == "at") {
+        dev.activate = std::stod(value);
+      } else {
+        throw std::runtime_error("unknown device option '" + key + "'");
+      }
+    }
+
+    script.devices[slot] = std::move(dev);
+  }
+
+  void parsePose(Script &script, std::istream &in) {
+    auto &dev = scriptedDevice(script, slotField(in));
+
+    Keyframe key{ field<double>(in, "time"), {}, {} };
+    for(auto &p: key.position) {
+      p = field<float>(in, "position");
+    }
+    // Rotation is optional
+    for(auto &r: key.rotation) {
+      r = in >> r ? r * DEG2RAD : 0;
+    }
+
+    auto pos = std::upper_bound(dev.keyframes.begin(), dev.keyframes.end(), key.time, [](double time, const Keyframe &k) {
+      return time < k.time;
+    });
+    dev.keyframes.insert(pos, key);
+  }
+
+  ScriptedEvent eventHeader(std::istream &in) {
+    ScriptedEvent ev;
+    ev.time = field<double>(in, "time");
+    ev.event.trackedDeviceIndex = slotField(in);
+    return ev;
+  }
+
+  void parseEvent(Script &script, std::istream &in) {
+    auto ev = eventHeader(in);
+    ev.event.eventType = lookup(eventmap, field<std::string>(in, "event type"), "event type");
+    uint32_t count;
+    if(in >> count) {
+      ev.count = count;
+    }
+    script.events.push_back(ev);
+  }
+
+  void parseProperty(Script &script, std::istream &in) {
+    auto ev = eventHeader(in);
+    scriptedDevice(script, ev.event.trackedDeviceIndex);
+    ev.event.eventType = vr::VREvent_PropertyChanged;
+    ev.event.data.property.prop = lookup(propmap, field<std::string>(in, "property"), "property");
+    ev.value = text(in, "value");
+    script.events.push_back(ev);
+  }
+
+  void parseConnect(Script &script, std::istream &in) {
+    auto ev = eventHeader(in);
+    scriptedDevice(script, ev.event.trackedDeviceIndex);
+    ev.connected = field<int>(in, "connected state") != 0;
+    ev.event.eventType = *ev.connected ? vr::VREvent_TrackedDeviceActivated : vr::VREvent_TrackedDeviceDeactivated;
+    script.events.push_back(ev);
+  }
+
+  // Fills in what the runtime derives from the display settings
+  void finishScript(Script &script) {
+    if(auto &hmd = script.devices[vr::k_unTrackedDeviceIndex_Hmd]) {
+      hmd->props.try_emplace(vr::Prop_DisplayFrequency_Float, std::to_string(script.frequency));
+      hmd->props.try_emplace(vr::Prop_SecondsFromVsyncToPhotons_Float, std::to_string(script.photons));
+    }
+
+    // Activations of devices that appear later are raised like any other event
+    for(unsigned slot = 0; slot < vr::k_unMaxTrackedDeviceCount; slot++) {
+      if(script.devices[slot] && script.devices[slot]->activate > 0) {
+        ScriptedEvent ev;
+        ev.time = script.devices[slot]->activate;
+        ev.event.eventType = vr::VREvent_TrackedDeviceActivated;
+        ev.event.trackedDeviceIndex = slot;
+        script.events.push_back(ev);
+      }
+    }
+
+    std::stable_sort(script.events.begin(), script.events.end(), [](const auto &a, const auto &b) {
+      return a.time < b.time;
+    });
+  }
+}
+
+
+/*
+ * Module exports
+ */
+
+Script loadScript(std::istream &in) {
+  Script script;
+
+  std::string line;
+  unsigned lineno = 0;
+  while(std::getline(in, line)) {
+    ++lineno;
+    if(auto comment = line.find('#'); comment != std::string::npos) {
+      line.erase(comment);
+    }
+
+    std::istringstream fields(line);
+    std::string command;
+    if(!(fields >> command)) continue;
+
+    try {
+      if(command == "display") {
+        script.frequency = field<float>(fields, "frequency");
+        script.photons = field<float>(fields, "seconds from vsync to photons");
+      } else if(command == "playarea") {
+        script.playarea[0] = field<float>(fields, "width");
+        script.playarea[1] = field<float>(fields, "depth");
+      } else if(command == "loop") {
+        script.loop = field<double>(fields, "period");
+      } else if(command == "device") {
+        parseDevice(script, fields);
+      } else if(command == "pose") {
+        parsePose(script, fields);
+      } else if(command == "event") {
+        parseEvent(script, fields);
+      } else if(command == "property") {
+        parseProperty(script, fields);
+      } else if(command == "connect") {
+        parseConnect(script, fields);
+      } else {
+        throw std::runtime_error("unknown command '" + command + "'");
+      }
+    } catch(std::exception &err) {
+      throw std::runtime_error("script line " + std::to_string(lineno) + ": " + err.what());
+    }
+  }
+
+  finishScript(script);
+  return script;
+}
+
+Script defaultScript() {
+  std::istringstream in(R"(
+    device 0 hmd standin hmd standin-hmd style=lighthouse
+    device 1 controller standin controller standin-left role=left
+    device 2 controller standin controller standin-right role=right
+    pose 0 0 0 1.7 0
+    pose 1 0 -0.25 1.1 -0.3 0 -30 0
+    pose 1 2 -0.15 1.2 -0.4 20 -20 10
+    pose 1 4 -0.25 1.1 -0.3 0 -30 0
+    pose 2 0 0.25 1.1 -0.3 0 -30 0
+    pose 2 2 0.35 1.0 -0.2 -20 -40 -10
+    pose 2 4 0.25 1.1 -0.3 0 -30 0
+    loop 4
+  )");
+  return loadScript(in);
+}
+
+const char *eventName(vr::EVREventType type) {
+  for(auto &[name, value]: eventmap) {
+    if(value == type) {
+      return name.c_str();
+    }
+  }
+  return nullptr;
+}
+
+}} // module exports
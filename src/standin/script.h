@@ -0,0 +1,93 @@
+/*
+ * This file is part of ovrly (https://github.com/joshperry/ovrly)
+ * Copyright (c) 2020 Joshua Perry
+ *
+ * This program can be redistributed and/or modified under the
+ * terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ */
+#pragma once
+
+#include <array>
+#include <istream>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "openvr.h"
+
+/**
+ * Scripts drive the stand-in runtime: the devices it reports, how they move,
+ * and the events it raises, all timed in seconds from `VR_Init`.
+ *
+ * A script is a text file with one command per line, `#` starts a comment
+ * and strings with spaces can be double-quoted:
+ *
+ *   display <hz> <vsync-to-photons-seconds>
+ *   playarea <width> <depth>
+ *   loop <seconds>                  # Repeat pose trajectories with this period
+ *   device <slot> <hmd|controller|tracker|reference> <manufacturer> <model> <serial>
+ *     [role=<left|right|optout|treadmill|stylus>] [style=<lighthouse|outside-in|inside-out>] [at=<seconds>]
+ *   pose <slot> <time> <x> <y> <z> [<yaw> <pitch> <roll>]   # Meters and degrees
+ *   event <time> <slot> <type> [count]    # `type` is an `EVREventType` without the `VREvent_` prefix
+ *   property <time> <slot> <prop> <value> # `prop` is an `ETrackedDeviceProperty` without the prefix or type suffix
+ *   connect <time> <slot> <0|1>
+ *
+ * Devices are interpolated linearly between their pose keyframes, with
+ * velocities from the keyframes' differences, and hold their first and last
+ * keyframes before and after them.
+ *
+ * Poses are standing-universe only. The stand-in ignores the tracking origin
+ * asked for by pose queries and overlay transforms, so scripts can't exercise
+ * seated or raw origins.
+ */
+
+namespace ovrly { namespace standin {
+
+  /** A scripted pose of a device at a time */
+  struct Keyframe {
+    double time;
+    float position[3]; // Meters in standing space
+    float rotation[3]; // Yaw, pitch, and roll in radians
+  };
+
+  struct ScriptedDevice {
+    vr::ETrackedDeviceClass type{ vr::TrackedDeviceClass_Invalid };
+    double activate{ 0 }; // Seconds until the device appears
+
+    // Property values as text, converted to the property's type when read
+    std::map<vr::ETrackedDeviceProperty, std::string> props;
+
+    std::vector<Keyframe> keyframes; // Ordered by time
+  };
+
+  struct ScriptedEvent {
+    double time{ 0 };
+    vr::VREvent_t event{};
+    uint32_t count{ 1 }; // Times the event is raised, for event storms
+
+    std::optional<std::string> value; // Property value set as a `VREvent_PropertyChanged` is raised
+    std::optional<bool> connected; // Connected state set as a `connect` event is raised
+  };
+
+  struct Script {
+    float frequency{ 90 };
+    float photons{ 0.011f };
+    float playarea[2]{ 2, 2 };
+    double loop{ 0 }; // 0 to hold the last keyframes instead of repeating
+
+    std::array<std::optional<ScriptedDevice>, vr::k_unMaxTrackedDeviceCount> devices;
+    std::vector<ScriptedEvent> events; // Ordered by time
+  };
+
+  /** Parses a script, throws `std::runtime_error` naming the line of any error */
+  Script loadScript(std::istream &in);
+
+  /** A script with a still HMD and two slowly swaying controllers, for when none is given */
+  Script defaultScript();
+
+  /** Gets the name of an event type, or null when it isn't one the stand-in knows */
+  const char *eventName(vr::EVREventType type);
+
+}} // namespaces
@@ -15,11 +15,26 @@
 #include <iostream>
 #include <string>
 #include <locale>
+#include <map>
 #include <codecvt>
 #include <ranges>
+#include <array>
+#include <bitset>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include "include/cef_command_line.h"
 
 #include "appovrly.h"
 #include "logging.h"
+#include "shmpose.h"
 
 namespace ovr = ::vr;
 using namespace std::ranges;
@@ -49,12 +64,904 @@ namespace {
   std::unique_ptr<std::thread> loop_;
   std::atomic<bool> done_;
 
-  // Set of openvr tracked device information
-  std::vector<TrackedDevice> devices_;
+  /**
+   * Tracked device state indexed by slot
+   *
+   * Pose data is rewritten for every slot each frame, so it's kept in
+   * contiguous arrays that are converted from the runtime's poses in one pass.
+   * Device properties only change on device events and are kept apart from it.
+   * Only touched by the VR thread once it's running.
+   */
+  struct DeviceTable {
+    // Slots that hold a device
+    std::bitset<ovr::k_unMaxTrackedDeviceCount> live;
+
+    // Properties of the device in each live slot, its pose fields are unused
+    std::array<TrackedDevice, ovr::k_unMaxTrackedDeviceCount> props;
+
+    // Column-major device-to-standing transforms, same layout as `mathfu::mat4`
+    alignas(64) float matrix[ovr::k_unMaxTrackedDeviceCount][16];
+    alignas(64) float predicted[ovr::k_unMaxTrackedDeviceCount][16];
+    alignas(64) float velocity[ovr::k_unMaxTrackedDeviceCount][3];
+    alignas(64) float angular[ovr::k_unMaxTrackedDeviceCount][3];
+    ovr::ETrackingResult result[ovr::k_unMaxTrackedDeviceCount];
+    bool valid[ovr::k_unMaxTrackedDeviceCount];
+    bool connected[ovr::k_unMaxTrackedDeviceCount];
+
+    // Pose state as last published, for detecting changes against
+    alignas(64) float publishedmatrix[ovr::k_unMaxTrackedDeviceCount][16];
+    ovr::ETrackingResult publishedresult[ovr::k_unMaxTrackedDeviceCount];
+    bool publishedvalid[ovr::k_unMaxTrackedDeviceCount];
+    bool publishedconnected[ovr::k_unMaxTrackedDeviceCount];
+
+    // `DeviceChange` flags of the fields changed since they were last published
+    uint8_t dirty[ovr::k_unMaxTrackedDeviceCount];
+
+    // Bumped whenever a slot's device is loaded or deactivated, so work queued for an earlier device can be told apart
+    uint32_t generation[ovr::k_unMaxTrackedDeviceCount];
+  } table_;
+
+  // Fields of a device that can change between publishes
+  enum DeviceChange : uint8_t {
+    PoseMoved = 1, // Moved or turned further than the thresholds
+    TrackingChanged = 2, // Pose validity or tracking result
+    ConnectedChanged = 4,
+    PropsChanged = 8,
+  };
+
+  // How far a device has to move, in meters, before its pose is published again
+  float positionepsilon_{ 0.0001f };
+
+  // How far a device has to turn, in radians, before its pose is published again
+  float rotationepsilon_{ 0.0002f };
 
   // Maximum device slot seen so far
   unsigned maxslot;
 
+  // Adds or refreshes the properties of the device in a slot
+  void loadDevice(unsigned slot) {
+    table_.props[slot] = TrackedDevice(slot);
+    table_.connected[slot] = table_.props[slot].connected;
+    table_.dirty[slot] |= PropsChanged;
+    table_.live.set(slot);
+    table_.generation[slot]++;
+    maxslot = std::max(maxslot, slot);
+  }
+
+  /**
+   * Converts the row-major 3x4 matrices of a batch of runtime poses into
+   * column-major 4x4 matrices, the same conversion as `to_mathfu`
+   */
+  void loadMatrices(const ovr::TrackedDevicePose_t *poses, unsigned count, float (*out)[16]) {
+    for(unsigned i = 0; i < count; i++) {
+      auto &m = poses[i].mDeviceToAbsoluteTracking.m;
+      auto o = out[i];
+      for(int col = 0; col < 4; col++) {
+        o[col * 4 + 0] = m[0][col];
+        o[col * 4 + 1] = m[1][col];
+        o[col * 4 + 2] = m[2][col];
+        o[col * 4 + 3] = 0;
+      }
+    }
+  }
+
+  // Loads a batch of runtime poses into the table's pose arrays
+  void loadPoses(const ovr::TrackedDevicePose_t *poses, unsigned count) {
+    loadMatrices(poses, count, table_.matrix);
+
+    for(unsigned i = 0; i < count; i++) {
+      auto &pose = poses[i];
+      for(int j = 0; j < 3; j++) {
+        table_.velocity[i][j] = pose.vVelocity.v[j];
+        table_.angular[i][j] = pose.vAngularVelocity.v[j];
+      }
+      table_.result[i] = pose.eTrackingResult;
+      table_.valid[i] = pose.bPoseIsValid;
+      table_.connected[i] = pose.bDeviceIsConnected;
+    }
+  }
+
+  /**
+   * Works out which fields of each live device changed since they were last
+   * published, returns whether any did
+   *
+   * Poses only count as changed once they move or turn past the epsilons, so
+   * sensor noise on a device sitting still doesn't keep the pipeline busy.
+   */
+  bool detectChanges() {
+    bool changed = false;
+    float poseps2 = positionepsilon_ * positionepsilon_;
+
+    for(unsigned slot = 0; slot <= maxslot; slot++) {
+      if(!table_.live[slot]) continue;
+
+      auto &m = table_.matrix[slot];
+      auto &p = table_.publishedmatrix[slot];
+      uint8_t dirty = table_.dirty[slot];
+
+      // Translation column
+      float dx = m[12] - p[12], dy = m[13] - p[13], dz = m[14] - p[14];
+      if(dx * dx + dy * dy + dz * dz > poseps2) {
+        dirty |= PoseMoved;
+      } else {
+        // For small turns, rotation elements change by about the angle turned
+        for(int col = 0; col < 3 && !(dirty & PoseMoved); col++) {
+          for(int row = 0; row < 3; row++) {
+            if(std::abs(m[col * 4 + row] - p[col * 4 + row]) > rotationepsilon_) {
+              dirty |= PoseMoved;
+              break;
+            }
+          }
+        }
+      }
+
+      if(table_.valid[slot] != table_.publishedvalid[slot] || table_.result[slot] != table_.publishedresult[slot]) {
+        dirty |= TrackingChanged;
+      }
+
+      if(table_.connected[slot] != table_.publishedconnected[slot]) {
+        dirty |= ConnectedChanged;
+      }
+
+      table_.dirty[slot] = dirty;
+      changed |= dirty != 0;
+    }
+
+    return changed;
+  }
+
+  // Records the dirty devices' state as published and clears their dirty flags
+  void markPublished() {
+    for(unsigned slot = 0; slot <= maxslot; slot++) {
+      if(!table_.dirty[slot]) continue;
+
+      std::copy(std::begin(table_.matrix[slot]), std::end(table_.matrix[slot]), table_.publishedmatrix[slot]);
+      table_.publishedresult[slot] = table_.result[slot];
+      table_.publishedvalid[slot] = table_.valid[slot];
+      table_.publishedconnected[slot] = table_.connected[slot];
+      table_.dirty[slot] = 0;
+    }
+  }
+
+  // Gets the pose of a slot from the table's pose arrays
+  DevicePose getPose(unsigned slot, const float (&matrix)[16]) {
+    DevicePose pose;
+    pose.matrix = mathfu::mat4(matrix);
+    pose.velocity = mathfu::vec3(table_.velocity[slot]);
+    pose.angular = mathfu::vec3(table_.angular[slot]);
+    pose.valid = table_.valid[slot];
+    pose.result = table_.result[slot];
+    return pose;
+  }
+
+  /**
+   * A fixed-capacity ring of the most recent timestamped poses of one device
+   *
+   * Written only by the VR thread, read from any thread without locks. Readers
+   * copy samples out and then discard any the writer may have lapped while
+   * they were copying, like the seqlock on the shared pose block.
+   */
+  class PoseHistory {
+    public:
+      typedef std::chrono::steady_clock clock;
+
+      // A bit under 3 seconds at 90Hz
+      static constexpr uint64_t Capacity = 256;
+
+      struct Sample {
+        clock::time_point time;
+        float matrix[16];
+        float velocity[3];
+        float angular[3];
+        ovr::ETrackingResult result;
+        bool valid;
+      };
+
+      /** Appends the state of a slot in the device table, VR thread only */
+      void push(clock::time_point time, unsigned slot) {
+        auto index = head_.load(std::memory_order_relaxed);
+
+        // Tells readers the sample about to be overwritten is no longer good
+        writing_.store(index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        auto &sample = samples_[index % Capacity];
+        sample.time = time;
+        std::copy(std::begin(table_.matrix[slot]), std::end(table_.matrix[slot]), sample.matrix);
+        std::copy(std::begin(table_.velocity[slot]), std::end(table_.velocity[slot]), sample.velocity);
+        std::copy(std::begin(table_.angular[slot]), std::end(table_.angular[slot]), sample.angular);
+        sample.result = table_.result[slot];
+        sample.valid = table_.valid[slot];
+
+        head_.store(index + 1, std::memory_order_release);
+      }
+
+      /**
+       * Copies the samples from `from` on into `out`, oldest first
+       *
+       * Also includes the latest sample from before `from` when there is one,
+       * so there's something to interpolate from.
+       */
+      void read(clock::time_point from, std::vector<Sample> &out) const {
+        out.clear();
+
+        // Newest first, until a sample from before `from`
+        auto head = head_.load(std::memory_order_acquire);
+        auto oldest = head > Capacity ? head - Capacity : 0;
+        for(auto index = head; index > oldest; --index) {
+          out.push_back(samples_[(index - 1) % Capacity]);
+          if(out.back().time < from) break;
+        }
+
+        // Order the copies before checking how far the writer got meanwhile
+        std::atomic_thread_fence(std::memory_order_acquire);
+        auto writing = writing_.load(std::memory_order_relaxed);
+
+        // Drop the oldest samples if their buffer entries were being reused
+        while(!out.empty() && head - out.size() + Capacity <= writing) {
+          out.pop_back();
+        }
+
+        std::reverse(out.begin(), out.end());
+      }
+
+    private:
+      std::array<Sample, Capacity> samples_;
+      std::atomic<uint64_t> head_{ 0 }; // Count of completed pushes
+      std::atomic<uint64_t> writing_{ 0 }; // Count of started pushes
+  };
+
+  // Pose history of each slot, only written for live slots
+  std::array<PoseHistory, ovr::k_unMaxTrackedDeviceCount> history_;
+
+  // How far past the latest sample `poseAt` will extrapolate
+  constexpr std::chrono::milliseconds maxextrapolation_{ 100 };
+
+  // Records the current pose of every live slot in its history
+  void recordHistory(PoseHistory::clock::time_point time) {
+    for(unsigned slot = 0; slot <= maxslot; slot++) {
+      if(table_.live[slot]) {
+        history_[slot].push(time, slot);
+      }
+    }
+  }
+
+  // Gets a pose from a history sample
+  DevicePose samplePose(const PoseHistory::Sample &sample) {
+    DevicePose pose;
+    pose.matrix = mathfu::mat4(sample.matrix);
+    pose.velocity = mathfu::vec3(sample.velocity);
+    pose.angular = mathfu::vec3(sample.angular);
+    pose.valid = sample.valid;
+    pose.result = sample.result;
+    return pose;
+  }
+
+  /**
+   * Blends two history samples, `t` of the way from `a` to `b`
+   *
+   * Rotations are slerped so the result stays orthonormal.
+   */
+  DevicePose interpolate(const PoseHistory::Sample &a, const PoseHistory::Sample &b, float t) {
+    auto from = samplePose(a), to = samplePose(b);
+
+    auto rotfrom = mathfu::quat::FromMatrix(mathfu::mat4::ToRotationMatrix(from.matrix));
+    auto rotto = mathfu::quat::FromMatrix(mathfu::mat4::ToRotationMatrix(to.matrix));
+    auto position = mathfu::vec3::Lerp(from.matrix.TranslationVector3D(), to.matrix.TranslationVector3D(), t);
+
+    DevicePose pose = t < 0.5f ? from : to;
+    pose.matrix = mathfu::mat4::FromRotationMatrix(mathfu::quat::Slerp(rotfrom, rotto, t).ToMatrix());
+    for(int i = 0; i < 3; i++) {
+      pose.matrix[12 + i] = position[i];
+    }
+    // Keep the homogeneous element the same as poses from the runtime
+    pose.matrix[15] = from.matrix[15];
+
+    pose.velocity = mathfu::vec3::Lerp(from.velocity, to.velocity, t);
+    pose.angular = mathfu::vec3::Lerp(from.angular, to.angular, t);
+    pose.valid = from.valid && to.valid;
+    return pose;
+  }
+
+  // Snapshots of the device table handed out to other threads
+  SnapshotRing<std::vector<TrackedDevice>> snapshots_;
+
+  // Whether a task raising `OnDevicesUpdated` is queued on the main thread
+  std::atomic<bool> updatepending_{ false };
+
+  // Whether anything is paced to display frames, and whether a task raising `OnDisplayFrame` is queued
+  std::atomic<bool> pacing_{ false };
+  std::atomic<bool> framepending_{ false };
+
+  // Count of frames that couldn't be published because readers held every snapshot buffer
+  uint64_t snapshotsdropped_{ 0 };
+
+  // Whether the table has poses loaded yet
+  bool posesloaded_{ false };
+
+  // Whether to also publish poses predicted for photon time
+  bool predict_{ true };
+
+  // Copies the current device states into a snapshot and publishes it
+  bool publishDevices() {
+    auto back = snapshots_.back();
+    if(!back) {
+      if(++snapshotsdropped_ % 100 == 1) {
+        logger::warn("(vr) snapshot buffers all held, {} device updates dropped", snapshotsdropped_);
+      }
+      return false;
+    }
+
+    // Assigning over the old snapshot reuses its allocations
+    back->resize(table_.live.count());
+    auto dev = back->begin();
+    for(unsigned slot = 0; slot <= maxslot; slot++) {
+      if(!table_.live[slot]) continue;
+
+      *dev = table_.props[slot];
+      dev->connected = table_.connected[slot];
+      if(posesloaded_) {
+        dev->pose = getPose(slot, table_.matrix[slot]);
+        if(predict_) {
+          dev->predicted = getPose(slot, table_.predicted[slot]);
+        }
+      }
+      ++dev;
+    }
+
+    snapshots_.publish();
+    return true;
+  }
+
+  // Shared memory channel for publishing poses to the render processes
+  std::unique_ptr<shm::PoseWriter> posewriter_;
+
+  // Copies a slot's pose state into its shared memory record
+  void toRecord(unsigned slot, shm::PoseRecord &rec) {
+    rec.connected = table_.connected[slot];
+    rec.valid = table_.valid[slot];
+    rec.result = table_.result[slot];
+
+    std::copy(std::begin(table_.matrix[slot]), std::end(table_.matrix[slot]), rec.matrix);
+    std::copy(std::begin(table_.velocity[slot]), std::end(table_.velocity[slot]), rec.velocity);
+    std::copy(std::begin(table_.angular[slot]), std::end(table_.angular[slot]), rec.angular);
+
+    // Fall back to the sampled pose when not predicting
+    auto &predicted = predict_ ? table_.predicted[slot] : table_.matrix[slot];
+    std::copy(std::begin(predicted), std::end(predicted), rec.predicted);
+  }
+
+  /**
+   * Paces the VR loop to the headset display, so poses are sampled once per
+   * display frame a fixed phase before its vsync
+   *
+   * Must only be used from the VR thread, other than `stats()`.
+   */
+  class FrameScheduler {
+    public:
+      typedef std::chrono::steady_clock clock;
+
+      /** Sets how many seconds before vsync to wake, kept within a display period */
+      void configure(float phase) {
+        configured_ = std::max(0.0f, phase);
+        phase_ = std::min(configured_, std::nextafter(1 / frequency_, 0.0f));
+      }
+
+      /** Reads the display timing properties of the HMD */
+      void refresh() {
+        auto vr = ovr::VRSystem();
+        ovr::TrackedPropertyError err;
+
+        auto frequency = vr->GetFloatTrackedDeviceProperty(ovr::k_unTrackedDeviceIndex_Hmd, ovr::Prop_DisplayFrequency_Float, &err);
+        if(err == ovr::TrackedProp_Success && frequency > 0) {
+          frequency_ = frequency;
+        }
+
+        // A phase of a period or more would wake for the frame after
+        configure(configured_);
+
+        auto photons = vr->GetFloatTrackedDeviceProperty(ovr::k_unTrackedDeviceIndex_Hmd, ovr::Prop_SecondsFromVsyncToPhotons_Float, &err);
+        vsynctophotons_ = err == ovr::TrackedProp_Success ? photons : 0;
+
+        logger::info("(vr) pacing to {}Hz display, waking {}ms before vsync", frequency_, phase_ * 1000);
+      }
+
+      /**
+       * Sleeps until the wake point of the next display frame that hasn't been sampled
+       *
+       * Returns the seconds from now until that frame's vsync.
+       */
+      float wait() {
+        float period = 1 / frequency_;
+
+        float sincevsync;
+        uint64_t frame;
+        if(!ovr::VRSystem()->GetTimeSinceLastVsync(&sincevsync, &frame)) {
+          // No vsync timing from the runtime, just keep to the display rate
+          std::this_thread::sleep_for(std::chrono::duration<float>(period));
+          return phase_;
+        }
+
+        // Aim for the vsync ending the current frame, or a later one if it was already sampled
+        uint64_t target = frame + 1;
+        float untilwake = period - sincevsync - phase_;
+        while(target <= lastframe_) {
+          ++target;
+          untilwake += period;
+        }
+
+        if(lastframe_ && target > lastframe_ + 1) {
+          missed_ += target - lastframe_ - 1;
+        }
+        lastframe_ = target;
+        ++frames_;
+
+        // Already past the wake point, sample late rather than skip the frame
+        float late = 0;
+        if(untilwake > 0) {
+          auto deadline = clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<float>(untilwake));
+          std::this_thread::sleep_until(deadline);
+          late = std::chrono::duration<float>(clock::now() - deadline).count();
+        } else {
+          late = -untilwake;
+        }
+
+        record(late, phase_ - late + vsynctophotons_);
+
+        return phase_ - late;
+      }
+
+      /**
+       * Gets the seconds from now until the photons of the frame last waited
+       * for are displayed, for predicting poses to that time
+       */
+      float secondsToPhotons() {
+        float sincevsync;
+        uint64_t frame;
+        if(!ovr::VRSystem()->GetTimeSinceLastVsync(&sincevsync, &frame)) {
+          return phase_ + vsynctophotons_;
+        }
+
+        // Frames until the target vsync, a frame can start between waking and sampling
+        float frames = lastframe_ > frame ? static_cast<float>(lastframe_ - frame) : 1;
+        return std::max(0.0f, frames / frequency_ - sincevsync) + vsynctophotons_;
+      }
+
+      /** The runtime's index of the display frame last waited for */
+      uint64_t frame() const {
+        return lastframe_;
+      }
+
+      /** Gets the stats of the last complete window */
+      SchedulerStats stats() {
+        std::lock_guard<std::mutex> lock(statsmutex_);
+        return stats_;
+      }
+
+    private:
+      // Accumulates a wakeup into the current window, publishing it once it's complete
+      void record(float late, float photons) {
+        ++windowcount_;
+        jittersum_ += late;
+        jittermax_ = std::max(jittermax_, late);
+        photonssum_ += photons;
+
+        // About a second's worth
+        if(windowcount_ < frequency_) {
+          return;
+        }
+
+        SchedulerStats stats{
+          frequency_, phase_, frames_, missed_,
+          jittersum_ / windowcount_, jittermax_, photonssum_ / windowcount_
+        };
+        {
+          std::lock_guard<std::mutex> lock(statsmutex_);
+          stats_ = stats;
+        }
+
+        if(++windows_ % 10 == 0) {
+          logger::debug("(vr) wake jitter mean {:.3f}ms max {:.3f}ms, {:.3f}ms to photons, {} frames missed",
+            stats.jitterMean * 1000, stats.jitterMax * 1000, stats.photonsMean * 1000, stats.missed);
+        }
+
+        windowcount_ = 0;
+        jittersum_ = jittermax_ = photonssum_ = 0;
+      }
+
+      float frequency_{ 90 };
+      float phase_{ 0.003f };
+      float configured_{ 0.003f }; // Phase asked for, `phase_` is that within the display period
+      float vsynctophotons_{ 0 };
+      uint64_t lastframe_{ 0 };
+      uint64_t frames_{ 0 };
+      uint64_t missed_{ 0 };
+
+      unsigned windowcount_{ 0 };
+      unsigned windows_{ 0 };
+      float jittersum_{ 0 };
+      float jittermax_{ 0 };
+      float photonssum_{ 0 };
+
+      std::mutex statsmutex_;
+      SchedulerStats stats_;
+  };
+
+  FrameScheduler scheduler_;
+
+  // Most runtime events handled per tick, the rest wait so poses are still sampled every frame
+  unsigned eventbudget_{ 64 };
+
+  // Largest budget `--vr-event-budget=` can set, the tick's event buffer is sized by it
+  constexpr unsigned MaxEventBudget = 1024;
+
+  void onDeviceActivated(const ovr::VREvent_t &event) {
+    // The index comes from the runtime, it's only used once it's known to be a table slot
+    if(event.trackedDeviceIndex >= ovr::k_unMaxTrackedDeviceCount) {
+      logger::error("(vr) activated device {} is out of range", event.trackedDeviceIndex);
+      return;
+    }
+
+    // See if this is a device we've seen already
+    if(!table_.live[event.trackedDeviceIndex]) {
+      logger::debug("(vr) added activated device {}", event.trackedDeviceIndex);
+      loadDevice(event.trackedDeviceIndex);
+    }
+  }
+
+  void onDeviceDeactivated(const ovr::VREvent_t &event) {
+    logger::debug("(vr) deactivated device {}", event.trackedDeviceIndex);
+    if(event.trackedDeviceIndex >= ovr::k_unMaxTrackedDeviceCount) {
+      return;
+    }
+
+    // Strings still being fetched belong to the device that left
+    table_.generation[event.trackedDeviceIndex]++;
+    /*
+    // The pose query should update the device to connected = false
+    table_.live.reset(event.trackedDeviceIndex);
+    */
+  }
+
+  /**
+   * Fetches string device properties off the VR thread
+   *
+   * String properties need a runtime call and a UTF-16 conversion each, which
+   * the VR thread shouldn't be waiting on. Fetched values are collected by the
+   * VR thread on its next tick.
+   */
+  class PropertyWorker {
+    public:
+      struct Fetched {
+        unsigned slot;
+        ovr::ETrackedDeviceProperty prop;
+        uint32_t generation; // Generation of the slot when the fetch was requested
+        std::optional<std::wstring> value; // Empty when the device doesn't provide the property
+      };
+
+      void start() {
+        thread_ = std::make_unique<std::thread>([this]() { run(); });
+      }
+
+      /** Queues a property to fetch for the slot's current `generation`, VR thread only */
+      void request(unsigned slot, ovr::ETrackedDeviceProperty prop, uint32_t generation) {
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          // A fetch already queued will get the latest value, it only needs the newer generation
+          auto queued = std::find_if(requests_.begin(), requests_.end(), [&](const Fetched &req) {
+            return req.slot == slot && req.prop == prop;
+          });
+          if(queued != requests_.end()) {
+            queued->generation = generation;
+            return;
+          }
+          requests_.push_back({ slot, prop, generation });
+        }
+        wake_.notify_one();
+      }
+
+      /** Stops the worker and waits for it to finish any fetch it's in */
+      void stop() {
+        if(!thread_) {
+          return;
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          done_ = true;
+        }
+        wake_.notify_one();
+        thread_->join();
+        thread_.reset();
+      }
+
+      /** Moves the values fetched since the last call into `out`, VR thread only */
+      void collect(std::vector<Fetched> &out) {
+        if(!ready_.load(std::memory_order_acquire)) {
+          return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        out.swap(results_);
+        results_.clear();
+        ready_ = false;
+      }
+
+    private:
+      void run() {
+        char buf[ovr::k_unMaxPropertyStringSize];
+        std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+
+        while(!done_) {
+          Fetched fetched;
+          {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this]() { return !requests_.empty() || done_; });
+            if(requests_.empty()) continue;
+            fetched = requests_.front();
+            requests_.erase(requests_.begin());
+          }
+
+          ovr::TrackedPropertyError err;
+          ovr::VRSystem()->GetStringTrackedDeviceProperty(fetched.slot, fetched.prop, buf, ovr::k_unMaxPropertyStringSize, &err);
+          if(err == ovr::ETrackedPropertyError::TrackedProp_Success) {
+            fetched.value = converter.from_bytes(buf);
+          }
+
+          std::lock_guard<std::mutex> lock(mutex_);
+          results_.push_back(std::move(fetched));
+          ready_.store(true, std::memory_order_release);
+        }
+      }
+
+      std::unique_ptr<std::thread> thread_;
+      std::mutex mutex_;
+      std::condition_variable wake_;
+      std::vector<Fetched> requests_; // Values are left empty until fetched
+      std::vector<Fetched> results_;
+      std::atomic<bool> ready_{ false }; // Whether there are results, so the VR thread can skip the lock
+  };
+
+  PropertyWorker propworker_;
+
+  // Strings fetched by the worker, reused between ticks
+  std::vector<PropertyWorker::Fetched> fetched_;
+
+  // Properties whose cached value changed, to notify once the change is published
+  std::vector<std::pair<unsigned, ovr::ETrackedDeviceProperty>> propchanges_;
+
+  /**
+   * How a device property is kept in the device table
+   *
+   * Numeric properties are cheap enough to refresh on the VR thread, string
+   * properties are fetched by the worker into a `TrackedDevice` field.
+   */
+  struct PropertyBinding {
+    bool (*refresh)(unsigned slot, TrackedDevice &dev); // Refreshes the cached value, returns whether it changed
+    std::wstring TrackedDevice::*field; // The field string properties are cached in
+  };
+
+  // Map from device property to how it's kept, properties not in here aren't cached
+  std::unordered_map<ovr::ETrackedDeviceProperty, PropertyBinding> propbindings_ = {
+    {ovr::Prop_DeviceClass_Int32, { [](unsigned slot, TrackedDevice &dev) {
+      auto vr = ovr::VRSystem();
+      auto type = vr->GetTrackedDeviceClass(slot);
+      if(std::exchange(dev.type, type) == type) return false;
+
+      // The class specific properties follow the class, as when the device was loaded
+      dev.trackingStyle.reset();
+      dev.role.reset();
+      if(type == ovr::TrackedDeviceClass_HMD) {
+        ovr::TrackedPropertyError err;
+        dev.trackingStyle = static_cast<ovr::EHmdTrackingStyle>(vr->GetInt32TrackedDeviceProperty(slot, ovr::Prop_HmdTrackingStyle_Int32, &err));
+      } else if(type == ovr::TrackedDeviceClass_Controller) {
+        dev.role = vr->GetControllerRoleForTrackedDeviceIndex(slot);
+      }
+      return true;
+    }, nullptr }},
+    {ovr::Prop_HmdTrackingStyle_Int32, { [](unsigned slot, TrackedDevice &dev) {
+      if(dev.type != ovr::TrackedDeviceClass_HMD) return false;
+      ovr::TrackedPropertyError err;
+      auto style = static_cast<ovr::EHmdTrackingStyle>(ovr::VRSystem()->GetInt32TrackedDeviceProperty(slot, ovr::Prop_HmdTrackingStyle_Int32, &err));
+      return std::exchange(dev.trackingStyle, style) != style;
+    }, nullptr }},
+    {ovr::Prop_ControllerRoleHint_Int32, { [](unsigned slot, TrackedDevice &dev) {
+      if(dev.type != ovr::TrackedDeviceClass_Controller) return false;
+      auto role = ovr::VRSystem()->GetControllerRoleForTrackedDeviceIndex(slot);
+      return std::exchange(dev.role, role) != role;
+    }, nullptr }},
+    {ovr::Prop_ManufacturerName_String, { nullptr, &TrackedDevice::manufacturer }},
+    {ovr::Prop_ModelNumber_String, { nullptr, &TrackedDevice::model }},
+    {ovr::Prop_SerialNumber_String, { nullptr, &TrackedDevice::serial }},
+  };
+
+  // Notes a changed property of a device for publishing
+  void propertyChanged(unsigned slot, ovr::ETrackedDeviceProperty prop) {
+    table_.dirty[slot] |= PropsChanged;
+    propchanges_.emplace_back(slot, prop);
+  }
+
+  // Applies the strings the worker fetched since the last tick to the device table
+  void applyFetchedProperties() {
+    propworker_.collect(fetched_);
+    for(auto &fetched: fetched_) {
+      // Drop strings fetched for a device that has since left the slot
+      if(!table_.live[fetched.slot] || fetched.generation != table_.generation[fetched.slot]) continue;
+
+      auto &value = table_.props[fetched.slot].*(propbindings_[fetched.prop].field);
+      auto fresh = fetched.value.value_or(std::wstring());
+      if(value != fresh) {
+        value = std::move(fresh);
+        propertyChanged(fetched.slot, fetched.prop);
+      }
+    }
+    fetched_.clear();
+  }
+
+  void onPropertyChanged(const ovr::VREvent_t &event) {
+    // Only refresh the property that changed, and only if it's one that's kept
+    auto slot = event.trackedDeviceIndex;
+    auto binding = propbindings_.find(event.data.property.prop);
+    if(slot < ovr::k_unMaxTrackedDeviceCount && table_.live[slot] && binding != propbindings_.end()) {
+      if(binding->second.refresh) {
+        if(binding->second.refresh(slot, table_.props[slot])) {
+          propertyChanged(slot, event.data.property.prop);
+        }
+      } else {
+        propworker_.request(slot, event.data.property.prop, table_.generation[slot]);
+      }
+    }
+
+    // The display can change refresh rate while running
+    if(event.trackedDeviceIndex == ovr::k_unTrackedDeviceIndex_Hmd &&
+        (event.data.property.prop == ovr::Prop_DisplayFrequency_Float || event.data.property.prop == ovr::Prop_SecondsFromVsyncToPhotons_Float)) {
+      scheduler_.refresh();
+    }
+  }
+
+  // Counters of the VR thread's event handling, read from other threads
+  struct {
+    std::atomic<uint64_t> ticks{ 0 };
+    std::atomic<uint64_t> events{ 0 };
+    std::atomic<unsigned> maxpertick{ 0 };
+    std::atomic<uint64_t> deferred{ 0 };
+    std::atomic<uint64_t> skipped{ 0 };
+    std::atomic<uint64_t> maindropped{ 0 };
+  } eventcounters_;
+
+  // Event types up to the end of the vendor-specific range can be routed
+  constexpr uint32_t EventTypeCount = ovr::VREvent_VendorSpecific_Reserved_End + 1;
+
+  // How events of a type are routed
+  enum EventRoute : uint8_t {
+    RouteVR = 1, // Has handlers on the VR thread
+    RouteMain = 2, // Has handlers on the main thread
+    RouteLogged = 4, // Has no handlers, and one was logged as skipped already
+  };
+
+  // `EventRoute` flags indexed by event type, so unhandled events cost one lookup
+  std::array<uint8_t, EventTypeCount> eventroutes_{};
+
+  // Handlers of each routed event type by the thread they run on, not modified once the VR thread starts
+  std::unordered_map<uint32_t, Event<const ovr::VREvent_t&>> vrhandlers_;
+  std::unordered_map<uint32_t, Event<const ovr::VREvent_t&>> mainhandlers_;
+
+  // Events routed to the main thread in the current tick, VR thread only
+  std::vector<ovr::VREvent_t> mainbatch_;
+
+  // Events waiting for the main thread, past this many only the latest of each type and device are kept
+  const size_t MAIN_QUEUE_LIMIT = 4096;
+  std::mutex mainqueuemutex_;
+  std::vector<ovr::VREvent_t> mainqueue_;
+  std::atomic<bool> mainpending_{ false };
+
+  // Raises the queued events on the main thread
+  void drainMainEvents() {
+    std::vector<ovr::VREvent_t> events;
+    {
+      std::lock_guard<std::mutex> lock(mainqueuemutex_);
+      mainpending_ = false;
+      events.swap(mainqueue_);
+    }
+
+    for(auto &event: events) {
+      mainhandlers_.find(event.eventType)->second(event);
+    }
+  }
+
+  /**
+   * Drops all but the latest event of each type and device from the queue,
+   * so a stalled main thread still gets one-off events like `VREvent_Quit`
+   */
+  void collapseMainEvents() {
+    thread_local std::unordered_set<uint64_t> seen;
+    seen.clear();
+
+    // Walk back from the newest, keeping the first of each seen
+    auto kept = mainqueue_.rbegin();
+    for(auto it = mainqueue_.rbegin(); it != mainqueue_.rend(); ++it) {
+      auto key = (static_cast<uint64_t>(it->eventType) << 32) | it->trackedDeviceIndex;
+      if(seen.insert(key).second) {
+        *kept++ = *it;
+      }
+    }
+
+    auto dropped = static_cast<size_t>(mainqueue_.rend() - kept);
+    mainqueue_.erase(mainqueue_.begin(), mainqueue_.begin() + dropped);
+
+    if(eventcounters_.maindropped.fetch_add(dropped, std::memory_order_relaxed) == 0 && dropped) {
+      logger::warn("(vr) main thread is behind, dropping superseded VR events");
+    }
+  }
+
+  // Hands the tick's main thread events over in one task
+  void queueMainEvents() {
+    {
+      std::lock_guard<std::mutex> lock(mainqueuemutex_);
+      mainqueue_.insert(mainqueue_.end(), mainbatch_.begin(), mainbatch_.end());
+      if(mainqueue_.size() > MAIN_QUEUE_LIMIT) {
+        collapseMainEvents();
+      }
+    }
+    mainbatch_.clear();
+
+    if(!mainpending_.exchange(true)) {
+      process::runOnMain(drainMainEvents);
+    }
+  }
+
+  void dispatchEvent(const ovr::VREvent_t &event) {
+    auto route = event.eventType < EventTypeCount ? eventroutes_[event.eventType] : 0;
+
+    if(route & RouteVR) {
+      vrhandlers_.find(event.eventType)->second(event);
+    }
+    if(route & RouteMain) {
+      mainbatch_.push_back(event);
+    }
+    if(route & (RouteVR | RouteMain)) {
+      return;
+    }
+
+    // Some events come by the thousand (e.g. `VREvent_ActionBindingReloaded`),
+    // only log the first of each type
+    eventcounters_.skipped.fetch_add(1, std::memory_order_relaxed);
+    if(event.eventType < EventTypeCount && !(route & RouteLogged)) {
+      eventroutes_[event.eventType] |= RouteLogged;
+      logger::debug("(vr) event skipped ({}): {}", event.trackedDeviceIndex, ovr::VRSystem()->GetEventTypeNameFromEnum(static_cast<ovr::EVREventType>(event.eventType)));
+    }
+  }
+
+  /**
+   * Pulls up to a tick's budget of events from the runtime into `batch` and
+   * dispatches them, returns how many there were
+   */
+  unsigned processEvents(std::vector<ovr::VREvent_t> &batch) {
+    unsigned count = 0;
+    while(count < batch.size() && ovr::VRSystem()->PollNextEvent(&batch[count], sizeof(ovr::VREvent_t))) {
+      ++count;
+    }
+
+    for(unsigned i = 0; i < count; i++) {
+      dispatchEvent(batch[i]);
+    }
+    if(!mainbatch_.empty()) {
+      queueMainEvents();
+    }
+
+    eventcounters_.ticks.fetch_add(1, std::memory_order_relaxed);
+    eventcounters_.events.fetch_add(count, std::memory_order_relaxed);
+    if(count > eventcounters_.maxpertick.load(std::memory_order_relaxed)) {
+      eventcounters_.maxpertick.store(count, std::memory_order_relaxed);
+    }
+    // A full batch probably left events queued for the next tick
+    if(count == batch.size()) {
+      eventcounters_.deferred.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return count;
+  }
+
   void initVR() {
     logger::info("OPENVR INITIALIZING");
     ovr::EVRInitError initerr = ovr::VRInitError_None;
@@ -72,97 +979,107 @@ namespace {
       // Create and store device instances for each valid slot
       auto type = ovr::VRSystem()->GetTrackedDeviceClass(i);
       if(type != ovr::ETrackedDeviceClass::TrackedDeviceClass_Invalid) {
-        devices_.push_back(TrackedDevice(i));
-        maxslot = std::max(maxslot, i);
+        loadDevice(i);
       }
     }
 
+    // Pace polling to the display
+    scheduler_.refresh();
+
+    // Listeners may get the devices from when they're notified the module is ready
+    publishDevices();
+
+    // Changed string properties are fetched in the background
+    propworker_.start();
+
+    // Create the shared pose block before anyone can look for it
+    posewriter_ = shm::PoseWriter::Create();
+
     // Notify listeners that the vr module is initialized
     OnReady();
 
     // VR event dispatch loop
     loop_ = std::make_unique<std::thread>([vrsys]() {
-      int binding_reloaded = 0;
-      ovr::VREvent_t event;
+      std::vector<ovr::VREvent_t> events(eventbudget_);
       ovr::TrackedDevicePose_t poses[ovr::k_unMaxTrackedDeviceCount];
+      ovr::TrackedDevicePose_t predicted[ovr::k_unMaxTrackedDeviceCount];
       while(!done_) {
-        // Get the next event if there is one
-        if (ovr::VRSystem()->PollNextEvent(&event, sizeof(event))) {
+        // Start work paced to the display first, it has the least time to spare before vsync
+        if(pacing_.load(std::memory_order_relaxed) && !framepending_.exchange(true)) {
+          process::runOnMain([frame = scheduler_.frame()]() {
+            framepending_ = false;
+            OnDisplayFrame(frame);
+          });
+        }
 
-          // Handle device add/remove events
-          switch(event.eventType) {
-          // Device added
-          case ovr::EVREventType::VREvent_TrackedDeviceActivated:
-          {
-            // See if this is a device we've seen already
-            auto it = std::find_if(devices_.begin(), devices_.end(),
-                [&event](const TrackedDevice &dev){ return event.trackedDeviceIndex == dev.slot; });
-            if(it == devices_.end()) {
-              logger::debug("(vr) added activated device {}", event.trackedDeviceIndex);
-              devices_.push_back(TrackedDevice(event.trackedDeviceIndex));
-              maxslot = std::max(maxslot, event.trackedDeviceIndex);
-            }
-          }
-          break;
-          case ovr::EVREventType::VREvent_PropertyChanged:
-          {
-            // See if this is a device we've seen already
-            auto it = std::find_if(devices_.begin(), devices_.end(),
-                [&event](const TrackedDevice &dev){ return event.trackedDeviceIndex == dev.slot; });
-
-            if(it != devices_.end()) {
-              auto fresh = TrackedDevice(it->slot);
-              logger::debug("(vr) device property changed {}", it->slot);
-              *it = fresh;
-            }
-          }
-          break;
+        // Handle pending events, device changes are picked up by this tick's poses
+        processEvents(events);
+        applyFetchedProperties();
 
-          // Device removed
-          case ovr::EVREventType::VREvent_TrackedDeviceDeactivated:
-          {
-            logger::debug("(vr) deactivated device {}", event.trackedDeviceIndex);
-            /*
-            // The pose query should update the device to connected = false
-            std::erase_if(devices_, [&event](const TrackedDevice &dev){ return event.trackedDeviceIndex == dev.slot; });
-            auto max = std::max_element(devices_.begin(), devices_.end(),
-                [](const auto &lhs, const auto &rhs) { return lhs.slot < rhs.slot; });
-            maxslot = max->slot;
-            */
-          }
-          break;
+        // Get the current set of device poses
+        auto sampled = PoseHistory::clock::now();
+        ovr::VRSystem()->GetDeviceToAbsoluteTrackingPose(ovr::ETrackingUniverseOrigin::TrackingUniverseStanding, 0, poses, maxslot+1);
+        // And where they're expected to be when this frame reaches the display
+        float photons = 0;
+        if(predict_) {
+          photons = scheduler_.secondsToPhotons();
+          ovr::VRSystem()->GetDeviceToAbsoluteTrackingPose(ovr::ETrackingUniverseOrigin::TrackingUniverseStanding, photons, predicted, maxslot+1);
+        }
 
-          case ovr::EVREventType::VREvent_ActionBindingReloaded:
-            if(++binding_reloaded%1000 == 0)
-              logger::debug("(vr) reloaded {}", binding_reloaded);
-            break;
+        // Update device poses and connected state for every slot in one pass
+        loadPoses(poses, maxslot+1);
+        if(predict_) {
+          loadMatrices(predicted, maxslot+1, table_.predicted);
+        }
+        posesloaded_ = true;
 
-          default:
-            logger::debug("(vr) event skipped ({}): {}", event.trackedDeviceIndex, ovr::VRSystem()->GetEventTypeNameFromEnum(static_cast<ovr::EVREventType>(event.eventType)));
-            break;
-          }
+        // History is kept every frame, a device sitting still still has a pose at each time
+        recordHistory(sampled);
 
-          continue; // Continue loop until no events are pending
+        // Nothing downstream needs to do anything while no device has changed
+        if(!detectChanges()) {
+          scheduler_.wait();
+          continue;
         }
 
-        // Get the current set of device poses
-        ovr::VRSystem()->GetDeviceToAbsoluteTrackingPose(ovr::ETrackingUniverseOrigin::TrackingUniverseStanding, 0, poses, maxslot+1);
-        // Add/update device pose and connected state
-        for(auto& pd: devices_) {
-          auto& pose = poses[pd.slot];
-          pd.pose = DevicePose(pose);
-          pd.connected = pose.bDeviceIsConnected;
+        // Publish the changed poses to render processes, they read them without waiting on IPC
+        if(posewriter_) {
+          auto records = posewriter_->begin();
+          for(unsigned slot = 0; slot <= maxslot; slot++) {
+            if(!table_.dirty[slot]) continue;
+
+            toRecord(slot, records[slot]);
+            records[slot].photons = photons;
+            records[slot].frame = posewriter_->frame();
+          }
+          posewriter_->commit();
         }
 
         // TODO: Get controller input states
 
-        // Dispatch device update observable to notify listeners
-        process::runOnMain([devices = std::make_shared<const std::vector<TrackedDevice>>(devices_)]() {
-          OnDevicesUpdated(devices);
-        });
+        // Dispatch device update observable to notify listeners, with the latest
+        // snapshot when the task runs if the main thread is behind
+        bool published = publishDevices();
+        if(published && !updatepending_.exchange(true)) {
+          process::runOnMain([]() {
+            updatepending_ = false;
+            OnDevicesUpdated(snapshots_.acquire());
+          });
+        }
+
+        // Then which properties changed, once a snapshot with their new values is out
+        if(published && !propchanges_.empty()) {
+          process::runOnMain([changes = propchanges_]() {
+            for(auto &[slot, prop]: changes) {
+              OnDevicePropertyChanged(slot, prop);
+            }
+          });
+          propchanges_.clear();
+        }
+        markPublished();
 
-        // Wait to loop next
-        std::this_thread::sleep_for(std::chrono::milliseconds(16));
+        // Wait for the next display frame
+        scheduler_.wait();
       }
     });
   }
@@ -170,11 +1087,216 @@ namespace {
   // A single graphics context to share between all overlays
   gfx::device_ptr gfxdev_;
 
+  // Most separate uploads a paint's dirty rects are merged down to
+  constexpr size_t MaxUploadBoxes = 4;
+
+  // Extra pixels worth uploading to save an upload call, boxes closer than this are merged
+  constexpr int64_t UploadCallPixels = 64 * 64;
+
+  // Fraction of a texture the dirty boxes can cover before it's cheaper to upload the whole thing
+  constexpr float FullUploadCoverage = 0.5f;
+
+  // Textures each overlay rotates through, so a paint never overwrites the one OpenVR is reading
+  constexpr size_t RingSize = 3;
+
+  // How often the upload thread checks on uploads the GPU hasn't finished
+  constexpr std::chrono::microseconds FencePollInterval{ 500 };
+
+  // Milliseconds between checks of whether a direct upload has finished, without the upload thread
+  constexpr int64_t SubmitRetryMs = 1;
+
+  // Paint upload timings, along with the totals to take the means from
+  std::mutex statsmutex_;
+  UploadStats uploadstats_;
+  double stagetotal_ = 0;
+  double uploadtotal_ = 0;
+
+  // Most damage rects a texture collects before they're collapsed into their bounds
+  constexpr size_t MaxDamageRects = 32;
+
+  // Adds a paint's dirty rects to the damage a texture has missed, no rects means all of it
+  void addDamage(std::vector<mathfu::recti> &damage, const std::vector<mathfu::recti> &dirty, int width, int height) {
+    if(dirty.empty()) {
+      damage.assign(1, mathfu::recti(0, 0, width, height));
+      return;
+    }
+
+    damage.insert(damage.end(), dirty.begin(), dirty.end());
+    if(damage.size() > MaxDamageRects) {
+      int left = width, top = height, right = 0, bottom = 0;
+      for(auto &rect: damage) {
+        left = std::min(left, rect.pos.x);
+        top = std::min(top, rect.pos.y);
+        right = std::max(right, rect.pos.x + rect.size.x);
+        bottom = std::max(bottom, rect.pos.y + rect.size.y);
+      }
+      damage.assign(1, mathfu::recti(left, top, right - left, bottom - top));
+    }
+  }
+
+  // A dirty region of a texture in pixels, right and bottom exclusive
+  struct Box {
+    int left, top, right, bottom;
+
+    int64_t area() const {
+      return static_cast<int64_t>(right - left) * (bottom - top);
+    }
+
+    Box merge(const Box &other) const {
+      return { std::min(left, other.left), std::min(top, other.top), std::max(right, other.right), std::max(bottom, other.bottom) };
+    }
+  };
+
+  /**
+   * Merges a paint's dirty rects, clipped to the texture, into a few boxes to upload
+   *
+   * The pair of boxes wasting the fewest clean pixels when merged is merged
+   * until there are at most `MaxUploadBoxes` and no pair is closer than
+   * `UploadCallPixels`. Paints only carry a handful of rects, so checking
+   * every pair is cheap.
+   */
+  void mergeDirty(const std::vector<mathfu::recti> &dirty, int width, int height, std::vector<Box> &boxes) {
+    boxes.clear();
+    for(auto &rect: dirty) {
+      Box box{ std::max(rect.pos.x, 0), std::max(rect.pos.y, 0),
+        std::min(rect.pos.x + rect.size.x, width), std::min(rect.pos.y + rect.size.y, height) };
+      if(box.left < box.right && box.top < box.bottom) {
+        boxes.push_back(box);
+      }
+    }
+
+    while(boxes.size() > 1) {
+      size_t first = 0, second = 0;
+      auto waste = std::numeric_limits<int64_t>::max();
+      for(size_t i = 0; i < boxes.size(); ++i) {
+        for(size_t j = i + 1; j < boxes.size(); ++j) {
+          // Negative when the boxes overlap
+          auto w = boxes[i].merge(boxes[j]).area() - boxes[i].area() - boxes[j].area();
+          if(w < waste) {
+            waste = w;
+            first = i;
+            second = j;
+          }
+        }
+      }
+
+      if(boxes.size() <= MaxUploadBoxes && waste > UploadCallPixels) break;
+
+      boxes[first] = boxes[first].merge(boxes[second]);
+      boxes[second] = boxes.back();
+      boxes.pop_back();
+    }
+  }
+
+  // A paint staged for the upload thread
+  struct UploadJob {
+    std::shared_ptr<OverlayTextures> textures;
+    size_t stage{ 0 }; // Staging buffer holding the paint
+    std::array<mathfu::recti, MaxUploadBoxes> dirty; // Regions changed since the last paint handed over
+    size_t count{ 0 };
+  };
+
+  /**
+   * Uploads staged paints to overlay textures and hands them to OpenVR
+   *
+   * Runs on its own thread with its own GL context sharing the device's
+   * objects, so painting threads only copy dirty regions into a staging
+   * buffer and return.
+   */
+  class UploadWorker {
+    public:
+      /** Creates the worker's context and starts it, on the thread that created `device` */
+      bool start(const gfx::device_ptr &device) {
+        context_ = device->create_shared_context();
+        if(!context_) {
+          return false;
+        }
+
+        thread_ = std::make_unique<std::thread>([this]() { run(); });
+        return true;
+      }
+
+      /** Stops the worker once it's done with the job it's on, its context can be destroyed after */
+      void stop() {
+        if(!thread_) {
+          return;
+        }
+
+        done_ = true;
+        posted_.fetch_add(1, std::memory_order_release);
+        posted_.notify_one();
+        thread_->join();
+        thread_.reset();
+        busy_.clear();
+        context_.reset();
+      }
+
+      /** Whether the worker was started, paints are uploaded on the painting thread when it wasn't */
+      bool running() const {
+        return thread_ != nullptr;
+      }
+
+      /** Hands a staged paint to the worker, false when it's too far behind. Painting thread only. */
+      bool queue(UploadJob &&job) {
+        if(!jobs_.push(std::move(job))) {
+          return false;
+        }
+
+        posted_.fetch_add(1, std::memory_order_release);
+        posted_.notify_one();
+        return true;
+      }
+
+    private:
+      void run();
+
+      std::unique_ptr<std::thread> thread_;
+      gfx::Context_ptr context_;
+      SpscQueue<UploadJob, 64> jobs_;
+      std::atomic<uint32_t> posted_{ 0 }; // Count of queued jobs, for the thread to sleep on while idle
+      std::vector<std::shared_ptr<OverlayTextures>> busy_; // Textures with uploads the GPU hasn't finished
+  };
+
+  UploadWorker uploader_;
+
   void onBrowserProcess(process::Browser& browser) {
+    // Render processes read poses from the block this process creates
+    browser.SubOnBeforeChildProcessLaunch.attach([](CefRefPtr<CefCommandLine> command_line) {
+      command_line->AppendSwitchWithValue(shm::PoseBlockSwitch, shm::PoseWriter::Name());
+    });
+
     // Init VR on the browser main thread, all events should be raised on this thread
     // also serializes creation of overlies until both the browser and VR stacks are ready
     browser.SubOnContextInitialized.attach([]() {
+      // How long before vsync to sample poses can be tuned with `--vr-wake-phase-ms=`
+      if(auto phase = getFloatSwitch("vr-wake-phase-ms")) {
+        scheduler_.configure(*phase / 1000);
+      }
+
+      // And how far devices move before they're published again with
+      // `--vr-position-epsilon=` in meters and `--vr-rotation-epsilon=` in radians
+      positionepsilon_ = std::max(0.0f, getFloatSwitch("vr-position-epsilon").value_or(positionepsilon_));
+      rotationepsilon_ = std::max(0.0f, getFloatSwitch("vr-rotation-epsilon").value_or(rotationepsilon_));
+
+      // Events handled per frame can be tuned with `--vr-event-budget=`
+      if(auto budget = getIntSwitch("vr-event-budget")) {
+        eventbudget_ = static_cast<unsigned>(std::clamp<long>(*budget, 1, MaxEventBudget));
+        if(static_cast<long>(eventbudget_) != *budget) {
+          logger::warn("(vr) --vr-event-budget={} is out of range, using {}", *budget, eventbudget_);
+        }
+      }
+
+      // Prediction costs a second pose query each frame, it can be turned off with `--vr-no-prediction`
+      predict_ = !CefCommandLine::GetGlobalCommandLine()->HasSwitch("vr-no-prediction");
+
+
+      // Paints are uploaded straight from CEF's buffer with `--vr-no-staging`, for drivers with bad persistent mapping
+      auto staged = !CefCommandLine::GetGlobalCommandLine()->HasSwitch("vr-no-staging");
+
       gfxdev_ = std::move(gfx::create_device());
+      if(staged && !uploader_.start(gfxdev_)) {
+        logger::error("(vr) Unable to start the overlay upload thread, uploading paints directly");
+      }
       initVR();
     });
   }
@@ -218,22 +1340,19 @@ DevicePose::DevicePose(ovr::TrackedDevicePose_t pose) :
 { }
 
 bool DevicePose::operator ==(const ::vr::TrackedDevicePose_t& b) const {
-  auto &nmat = b.mDeviceToAbsoluteTracking.m;
+  // Compare against the pose converted the way the constructor does it, OpenVR's matrix is row-major
+  auto nmat = to_mathfu(b.mDeviceToAbsoluteTracking);
+  for(int row = 0; row < 4; ++row) {
+    for(int col = 0; col < 4; ++col) {
+      if(matrix(row, col) != nmat(row, col)) {
+        return false;
+      }
+    }
+  }
+
   if(
-    matrix.data_[0].data_[0] != nmat[0][0] ||
-    matrix.data_[0].data_[1] != nmat[0][1] ||
-    matrix.data_[0].data_[2] != nmat[0][2] ||
-    matrix.data_[0].data_[3] != nmat[0][3] ||
-    matrix.data_[1].data_[0] != nmat[1][0] ||
-    matrix.data_[1].data_[1] != nmat[1][1] ||
-    matrix.data_[1].data_[2] != nmat[1][2] ||
-    matrix.data_[1].data_[3] != nmat[1][3] ||
-    matrix.data_[2].data_[0] != nmat[2][0] ||
-    matrix.data_[2].data_[1] != nmat[2][1] ||
-    matrix.data_[2].data_[2] != nmat[2][2] ||
-    matrix.data_[2].data_[3] != nmat[2][3] ||
-    !memcmp(&velocity.data_[0], &b.vVelocity.v[0], sizeof(float)*3) ||
-    !memcmp(&angular.data_[0], &b.vAngularVelocity.v[0], sizeof(float)*3) ||
+    memcmp(&velocity.data_[0], &b.vVelocity.v[0], sizeof(float)*3) != 0 ||
+    memcmp(&angular.data_[0], &b.vAngularVelocity.v[0], sizeof(float)*3) != 0 ||
     valid != b.bPoseIsValid ||
     result != b.eTrackingResult
   ) { return false; }
@@ -294,6 +1413,281 @@ TrackedDevice::TrackedDevice(unsigned slot) : slot(slot) {
   if(err == ovr::ETrackedPropertyError::TrackedProp_Success) { serial = converter.from_bytes(buf); }
 }
 
+/**
+ * The textures an overlay's paints are uploaded to and the buffers they're staged in
+ *
+ * Textures are rotated through so a paint is never uploaded to the one OpenVR
+ * is reading, and a texture is only handed to OpenVR once its upload has
+ * finished. Staging buffers are filled by the painting thread and freed by the
+ * upload thread once the GPU is done copying from them.
+ *
+ * Created for each target size, a resize replaces the whole set.
+ */
+struct OverlayTextures : std::enable_shared_from_this<OverlayTextures> {
+  struct Slot {
+    gfx::tex2_ptr texture;
+    std::vector<mathfu::recti> damage; // Dirty rects painted since the texture was last uploaded to
+  };
+
+  struct Stage {
+    gfx::pbo_ptr buffer; // Laid out like the paint buffer
+    std::vector<mathfu::recti> damage; // Dirty rects painted since the buffer was last staged in, painting thread only
+    std::atomic<bool> busy{ false }; // Whether the upload thread has the buffer
+  };
+
+  OverlayTextures(ovr::VROverlayHandle_t overlay, int width, int height, bool staged);
+
+  /** Uploads a staged paint to the next texture, upload thread only */
+  void upload(const UploadJob &job, const gfx::Context_ptr &ctx);
+
+  /**
+   * Uploads a paint's dirty regions to the next texture, from `source`, or from
+   * `staged` while it's bound when `source` is null, returns the pixels uploaded.
+   * Thread uploading only.
+   */
+  int64_t copy(const std::vector<mathfu::recti> &dirty, const void *source, const gfx::pbo_ptr &staged, const gfx::Context_ptr &ctx);
+
+  /** Frees finished staging buffers and submits a finished upload, true when nothing's left in flight */
+  bool finish();
+
+  /** Hands the pending texture to OpenVR, unless the textures went stale */
+  void submit();
+
+  /** Submits the pending texture once its upload has finished, checking back on the main thread until then */
+  void submitPending();
+
+  const ovr::VROverlayHandle_t overlay;
+  const int width;
+  const int height;
+
+  // Held while checking `stale` and handing a texture to OpenVR, and while the overlay is destroyed or replaced
+  std::mutex submitmutex;
+  bool stale{ false }; // Replaced or its overlay destroyed, nothing more goes to OpenVR
+
+  // Painting thread
+  std::array<Stage, RingSize> stages;
+  std::vector<mathfu::recti> unsent; // Dirty rects not yet handed to the upload thread
+  std::function<void()> repaint; // Has the overlay paint again, only while not stale
+  bool retrying{ false }; // Whether a check of the pending texture's fence is queued, without the upload thread
+
+  // A paint was dropped with every staging buffer busy, the upload thread asks for a repaint when it frees one
+  std::atomic<bool> wantsrepaint{ false };
+
+  // Upload thread, or the painting thread when there is none
+  std::array<Slot, RingSize> slots;
+  size_t submitted{ RingSize }; // Slot OpenVR has, `RingSize` for none
+  size_t pending{ RingSize }; // Slot uploaded to and waiting on its fence to be handed to OpenVR, `RingSize` for none
+  std::vector<size_t> inflight; // Stages the GPU may still be copying from
+  std::shared_ptr<OverlayTextures> retired; // The previous size's textures, kept until OpenVR has one of these
+  gfx::fence_ptr created; // Fences the creation of the textures and buffers, waited on before their first upload
+  ovr::Texture_t vrtexture{};
+};
+
+OverlayTextures::OverlayTextures(ovr::VROverlayHandle_t overlay, int width, int height, bool staged) :
+  overlay(overlay),
+  width(width),
+  height(height)
+{
+  // Create chromium-compatible(BGRA32) D3D/GL textures of the correct dims, with nothing in them yet
+  for(auto &slot: slots) {
+    slot.texture = gfxdev_->create_texture(width, height);
+    slot.damage.assign(1, mathfu::recti(0, 0, width, height));
+  }
+
+  // With staging buffers matching the paint buffers' layout, when paints go through the upload thread
+  for(auto &stage: stages) {
+    if(staged) {
+      stage.buffer = gfxdev_->create_pbo(static_cast<size_t>(width) * height * 4);
+      stage.damage.assign(1, mathfu::recti(0, 0, width, height));
+    }
+  }
+
+  // Objects created on one context are only guaranteed visible to another once it waits for them
+  created = gfxdev_->create_fence();
+
+  // Set the openvr static texture definition info
+  vrtexture.eType = gfx::TextureType;
+  vrtexture.eColorSpace = ovr::ColorSpace_Gamma;
+}
+
+void OverlayTextures::upload(const UploadJob &job, const gfx::Context_ptr &ctx) {
+  auto &stage = stages[job.stage];
+  if(std::lock_guard<std::mutex> lock(submitmutex); stale) {
+    stage.busy.store(false, std::memory_order_release);
+    return;
+  }
+
+  // The upload context can't use the textures or buffers until it has waited for their creation
+  if(created) {
+    created->wait(ctx);
+    created.reset();
+  }
+
+  thread_local std::vector<mathfu::recti> dirty;
+  dirty.assign(job.dirty.begin(), job.dirty.begin() + job.count);
+  copy(dirty, nullptr, stage.buffer, ctx);
+  inflight.push_back(job.stage);
+}
+
+int64_t OverlayTextures::copy(const std::vector<mathfu::recti> &dirty, const void *source, const gfx::pbo_ptr &staged, const gfx::Context_ptr &ctx) {
+  // Every texture misses this paint, each catches up on what it missed when it's next uploaded to
+  for(auto &slot: slots) {
+    addDamage(slot.damage, dirty, width, height);
+  }
+
+  // Upload to a texture that is neither with OpenVR nor waiting to be, there's always one with three
+  size_t next = 0;
+  while(next == submitted || next == pending) {
+    ++next;
+  }
+  auto &slot = slots[next];
+
+  // Only upload the parts of the texture that changed, unless most of it did
+  thread_local std::vector<Box> boxes;
+  mergeDirty(slot.damage, width, height, boxes);
+  slot.damage.clear();
+
+  int64_t covered = 0;
+  for(auto &box: boxes) {
+    covered += box.area();
+  }
+
+  // A staging buffer holds the whole paint, copies take offsets into it while it's bound
+  slot.texture->bind(ctx);
+  if(staged) {
+    staged->bind(ctx);
+  }
+  if(covered > FullUploadCoverage * width * height) {
+    covered = static_cast<int64_t>(width) * height;
+    slot.texture->copy_from(source);
+  } else {
+    for(auto &box: boxes) {
+      slot.texture->copy_from(source, box.left, box.top, box.right - box.left, box.bottom - box.top);
+    }
+  }
+
+  // Both the texture and the staging buffer wait on the GPU finishing the copies
+  slot.texture->fence();
+  if(staged) {
+    staged->fence();
+    staged->unbind();
+  }
+  slot.texture->unbind();
+  ctx->flush();
+
+  // Replacing any older upload still waiting to be handed to OpenVR
+  pending = next;
+  return covered;
+}
+
+bool OverlayTextures::finish() {
+  // Staging buffers the GPU has finished copying from can be painted into again
+  bool freed = false;
+  std::erase_if(inflight, [this, &freed](size_t index) {
+    auto &stage = stages[index];
+    if(!stage.buffer->wait(0)) {
+      return false;
+    }
+    stage.busy = false;
+    freed = true;
+    return true;
+  });
+
+  // Including the paint that was dropped for want of one, which is gone with its buffer
+  if(freed && wantsrepaint.exchange(false)) {
+    process::runOnMain([textures = shared_from_this()]() {
+      if(!textures->stale) {
+        textures->repaint();
+      }
+    });
+  }
+
+  if(pending < RingSize && slots[pending].texture->ready()) {
+    submit();
+  }
+
+  return inflight.empty() && pending >= RingSize;
+}
+
+void OverlayTextures::submit() {
+  // The overlay can't be destroyed, nor the textures replaced, between the check and the submit
+  std::lock_guard<std::mutex> lock(submitmutex);
+  if(stale) {
+    pending = RingSize;
+    return;
+  }
+
+  // Point the openvr texture descriptor at the d3d/GL texture
+  vrtexture.handle = slots[pending].texture->ovr_handle();
+  submitted = pending;
+  pending = RingSize;
+  retired.reset();
+
+  // Notify openvr of the texture
+  // TODO: Handle errors
+  auto err = ovr::VROverlay()->SetOverlayTexture(overlay, &vrtexture);
+  if(err != ovr::VROverlayError_None) {
+    logger::debug("!!!!(vr) Error setting overlay texture {}", err);
+  }
+}
+
+void OverlayTextures::submitPending() {
+  if(pending >= RingSize) return;
+
+  if(!slots[pending].texture->ready()) {
+    if(!retrying) {
+      retrying = true;
+      process::runOnMainAfter(SubmitRetryMs, [textures = weak_from_this()]() {
+        if(auto self = textures.lock()) {
+          self->retrying = false;
+          self->submitPending();
+        }
+      });
+    }
+    return;
+  }
+
+  submit();
+}
+
+void UploadWorker::run() {
+  context_->make_current();
+
+  UploadJob job;
+  while(!done_) {
+    auto seen = posted_.load(std::memory_order_acquire);
+
+    while(jobs_.pop(job)) {
+      auto start = std::chrono::steady_clock::now();
+      job.textures->upload(job, context_);
+      auto elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+
+      if(std::find(busy_.begin(), busy_.end(), job.textures) == busy_.end()) {
+        busy_.push_back(std::move(job.textures));
+      }
+      job.textures.reset();
+
+      std::lock_guard<std::mutex> lock(statsmutex_);
+      uploadstats_.uploads++;
+      uploadstats_.uploadLast = elapsed;
+      uploadstats_.uploadMax = std::max(uploadstats_.uploadMax, elapsed);
+      uploadtotal_ += elapsed;
+    }
+
+    // Hand finished uploads to OpenVR, and let go of textures once the GPU is done with them
+    std::erase_if(busy_, [](const auto &textures) {
+      return textures->finish();
+    });
+
+    // Sleep until a paint is queued when idle, otherwise check on the GPU again shortly
+    if(busy_.empty()) {
+      posted_.wait(seen, std::memory_order_acquire);
+    } else {
+      std::this_thread::sleep_for(FencePollInterval);
+    }
+  }
+}
+
 Overlay::Overlay(const std::string &name, mathfu::vec2 size) :
   size_(size),
   vroverlay_(ovr::k_ulOverlayHandleInvalid)
@@ -326,12 +1720,16 @@ Overlay::Overlay(const std::string &name, mathfu::vec2 size) :
     logger::error("OPENVR overlay interface unavailable");
   }
 
-  // Set the openvr static texture definition info
-  vrtexture_.eType = gfx::TextureType;
-  vrtexture_.eColorSpace = ovr::ColorSpace_Gamma;
 }
 
 Overlay::~Overlay() {
+  // The upload thread may still have paints of the overlay, it mustn't submit one once it's destroyed
+  std::unique_lock<std::mutex> lock;
+  if(textures_) {
+    lock = std::unique_lock<std::mutex>(textures_->submitmutex);
+    textures_->stale = true;
+  }
+
   if(vroverlay_ != ovr::k_ulOverlayHandleInvalid) {
     ovr::VROverlay()->DestroyOverlay(vroverlay_);
   }
@@ -359,23 +1757,116 @@ void Overlay::setParent(const Overlay& parent, const mathfu::mat4 &matrix) {
 }
 
 void Overlay::render(const void* buffer, const std::vector<mathfu::recti> &dirty) {
-  if(vroverlay_ == ovr::k_ulOverlayHandleInvalid) {
+  if(vroverlay_ == ovr::k_ulOverlayHandleInvalid || !textures_) {
     logger::error("OPENVR Overlay::render with no overlay");
     return;
   }
 
-  // TODO: Handle dirty rect optimization
+  auto start = std::chrono::steady_clock::now();
+  auto &textures = *textures_;
+  auto width = textures.width, height = textures.height;
 
-  // Bind and copy data from the chromium paint buffer to the texture
-  gfx::ScopedBinder<gfx::tex2> binder(gfxdev_, texture_);
-  texture_->copy_from(buffer);
+  // Without the upload thread the paint is uploaded before its buffer goes away, and handed to OpenVR once it's done
+  if(!uploader_.running()) {
+    auto covered = textures.copy(dirty, buffer, nullptr, gfxdev_->immediate_context());
+    textures.submitPending();
 
-  // Notify openvr of the texture
-  // TODO: Handle errors
-  auto err = ovr::VROverlay()->SetOverlayTexture(vroverlay_, &vrtexture_);
-  if(err != ovr::VROverlayError_None) {
-    logger::debug("!!!!(vr) Error setting overlay texture {}", err);
+    auto elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+
+    std::lock_guard<std::mutex> lock(statsmutex_);
+    uploadstats_.frames++;
+    uploadstats_.direct++;
+    uploadstats_.bytes += covered * 4;
+    uploadstats_.stageLast = elapsed;
+    uploadstats_.stageMax = std::max(uploadstats_.stageMax, elapsed);
+    stagetotal_ += elapsed;
+    return;
+  }
+
+  // Every staging buffer misses this paint, each catches up on what it missed when it's next staged in
+  for(auto &stage: textures.stages) {
+    addDamage(stage.damage, dirty, width, height);
+  }
+  addDamage(textures.unsent, dirty, width, height);
+
+  // Find a staging buffer the upload thread is done with
+  auto findStage = [&textures]() {
+    size_t index = 0;
+    while(index < RingSize && textures.stages[index].busy) {
+      ++index;
+    }
+    return index;
+  };
+
+  // Without one the paint is dropped rather than holding up this thread, and the upload
+  // thread asks for a repaint once it frees one, unless it did since looking
+  auto free = findStage();
+  if(free == RingSize) {
+    textures.wantsrepaint = true;
+    free = findStage();
+    if(free < RingSize) {
+      textures.wantsrepaint = false;
+    }
   }
+
+  int64_t covered = 0;
+  if(free < RingSize) {
+    // Bring the staging buffer up to date, it has the paint buffer's layout
+    auto &stage = textures.stages[free];
+    thread_local std::vector<Box> boxes;
+    mergeDirty(stage.damage, width, height, boxes);
+    stage.damage.clear();
+
+    auto src = static_cast<const uint8_t*>(buffer);
+    for(auto &box: boxes) {
+      covered += box.area();
+    }
+
+    if(covered > FullUploadCoverage * width * height) {
+      covered = static_cast<int64_t>(width) * height;
+      std::memcpy(stage.buffer->data(), src, covered * 4);
+    } else {
+      for(auto &box: boxes) {
+        auto rowbytes = static_cast<size_t>(box.right - box.left) * 4;
+        for(int row = box.top; row < box.bottom; ++row) {
+          auto offset = (static_cast<size_t>(row) * width + box.left) * 4;
+          std::memcpy(stage.buffer->data() + offset, src + offset, rowbytes);
+        }
+      }
+    }
+
+    // Hand it over with everything changed since the last paint that was
+    UploadJob job{ textures_, free };
+    mergeDirty(textures.unsent, width, height, boxes);
+    for(auto &box: boxes) {
+      job.dirty[job.count++] = mathfu::recti(box.left, box.top, box.right - box.left, box.bottom - box.top);
+    }
+
+    stage.busy.store(true, std::memory_order_relaxed);
+    if(uploader_.queue(std::move(job))) {
+      textures.unsent.clear();
+    } else {
+      stage.busy.store(false, std::memory_order_relaxed);
+      free = RingSize;
+
+      // The upload thread is too far behind to know when to ask, so the subclass paints again now
+      invalidate();
+    }
+  }
+
+  auto elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+
+  // What changed in a dropped paint stays in `unsent` for the repaint
+  std::lock_guard<std::mutex> lock(statsmutex_);
+  if(free < RingSize) {
+    uploadstats_.frames++;
+    uploadstats_.bytes += covered * 4;
+  } else {
+    uploadstats_.dropped++;
+  }
+  uploadstats_.stageLast = elapsed;
+  uploadstats_.stageMax = std::max(uploadstats_.stageMax, elapsed);
+  stagetotal_ += elapsed;
 }
 
 void Overlay::renderImageFile(const std::string &path) {
@@ -386,11 +1877,18 @@ void Overlay::renderImageFile(const std::string &path) {
 }
 
 void Overlay::updateTargetSize(mathfu::vec2i size, const std::tuple<mathfu::vec2, mathfu::vec2> &bounds) {
-  // Create a new chromium-compatible(BGRA32) D3D/GL texture of the correct dims
-  auto newtex = gfxdev_->create_texture(size.x, size.y);
-  // Point the openvr texture descriptor at the d3d/GL texture
-  vrtexture_.handle = newtex->ovr_handle();
-  texture_ = newtex;
+  auto textures = std::make_shared<OverlayTextures>(vroverlay_, size.x, size.y, uploader_.running());
+  textures->repaint = [this]() { invalidate(); };
+
+  // OpenVR keeps showing the current texture until one of the new size is ready to replace it
+  if(textures_) {
+    {
+      std::lock_guard<std::mutex> lock(textures_->submitmutex);
+      textures_->stale = true;
+    }
+    textures->retired = std::move(textures_);
+  }
+  textures_ = std::move(textures);
 
   ovr::VRTextureBounds_t vrbounds;
   vrbounds.uMin = std::get<0>(bounds).x;
@@ -402,10 +1900,70 @@ void Overlay::updateTargetSize(mathfu::vec2i size, const std::tuple<mathfu::vec2
 
 Event<> OnReady;
 
-Event<std::shared_ptr<const std::vector<TrackedDevice>>> OnDevicesUpdated;
+Event<DeviceSnapshot> OnDevicesUpdated;
+
+Event<unsigned, ::vr::ETrackedDeviceProperty> OnDevicePropertyChanged;
+
+Event<uint64_t> OnDisplayFrame;
+
+void paceDisplayFrames() {
+  pacing_ = true;
+}
+
+DeviceSnapshot getDevices() {
+  return snapshots_.acquire();
+}
+
+std::optional<DevicePose> poseAt(unsigned slot, std::chrono::steady_clock::time_point time) {
+  if(slot >= ovr::k_unMaxTrackedDeviceCount) {
+    return std::nullopt;
+  }
+
+  // Only the samples around `time` are needed, usually just a couple near the head
+  thread_local std::vector<PoseHistory::Sample> samples;
+  history_[slot].read(time, samples);
+  if(samples.empty() || samples.front().time > time) {
+    return std::nullopt;
+  }
+
+  // Past the latest sample, carry it forward along its velocities
+  auto &latest = samples.back();
+  if(time >= latest.time) {
+    if(time - latest.time > maxextrapolation_) {
+      return std::nullopt;
+    }
+
+    auto pose = samplePose(latest);
+    float ahead[16];
+    shm::extrapolate(latest.matrix, latest.velocity, latest.angular, std::chrono::duration<float>(time - latest.time).count(), ahead);
+    pose.matrix = mathfu::mat4(ahead);
+    return pose;
+  }
 
-const std::vector<TrackedDevice> &getDevices() {
-  return devices_;
+  // The first sample is the one from before `time`, the second is after it
+  auto &before = samples[0], &after = samples[1];
+  auto span = std::chrono::duration<float>(after.time - before.time).count();
+  auto t = span > 0 ? std::chrono::duration<float>(time - before.time).count() / span : 1.0f;
+  return interpolate(before, after, t);
+}
+
+std::vector<TimedPose> window(unsigned slot, std::chrono::steady_clock::duration duration) {
+  std::vector<TimedPose> poses;
+  if(slot >= ovr::k_unMaxTrackedDeviceCount) {
+    return poses;
+  }
+
+  auto from = PoseHistory::clock::now() - duration;
+  std::vector<PoseHistory::Sample> samples;
+  history_[slot].read(from, samples);
+
+  poses.reserve(samples.size());
+  for(auto &sample: samples) {
+    // Skip the sample from before the window kept for interpolating
+    if(sample.time < from) continue;
+    poses.push_back({ sample.time, samplePose(sample) });
+  }
+  return poses;
 }
 
 const ::vr::HmdQuad_t getPlaybounds() {
@@ -425,9 +1983,73 @@ const ::vr::HmdQuad_t getPlaybounds() {
     return {};
 }
 
+SchedulerStats getSchedulerStats() {
+  return scheduler_.stats();
+}
+
+EventStats getEventStats() {
+  return {
+    eventbudget_,
+    eventcounters_.ticks.load(std::memory_order_relaxed),
+    eventcounters_.events.load(std::memory_order_relaxed),
+    eventcounters_.maxpertick.load(std::memory_order_relaxed),
+    eventcounters_.deferred.load(std::memory_order_relaxed),
+    eventcounters_.skipped.load(std::memory_order_relaxed),
+    eventcounters_.maindropped.load(std::memory_order_relaxed),
+  };
+}
+
+UploadStats getUploadStats() {
+  std::lock_guard<std::mutex> lock(statsmutex_);
+  auto stats = uploadstats_;
+  stats.stageMean = stats.frames + stats.dropped ? static_cast<float>(stagetotal_ / (stats.frames + stats.dropped)) : 0;
+  stats.uploadMean = stats.uploads ? static_cast<float>(uploadtotal_ / stats.uploads) : 0;
+  return stats;
+}
+
+Event<const ::vr::VREvent_t&> &OnVREvent(::vr::EVREventType type, EventThread thread) {
+  // The VR thread reads the routes and handlers unlocked, so they can't change once it's running
+  if(loop_) {
+    logger::error("(vr) handler for event {} attached after the VR thread started, it won't be called", static_cast<uint32_t>(type));
+    static Event<const ::vr::VREvent_t&> detached;
+    return detached;
+  }
+
+  if(static_cast<uint32_t>(type) < EventTypeCount) {
+    eventroutes_[type] |= thread == EventThread::VR ? RouteVR : RouteMain;
+  }
+  return thread == EventThread::VR ? vrhandlers_[type] : mainhandlers_[type];
+}
+
+void shutdown() {
+  done_ = true;
+
+  // Nothing calls into the runtime once the VR thread and the workers have stopped
+  if(loop_ && loop_->joinable()) {
+    loop_->join();
+  }
+  propworker_.stop();
+  uploader_.stop();
+  if(gfxdev_) {
+    gfxdev_->destroy_shared_contexts();
+  }
+
+  if(loop_) {
+    posewriter_.reset();
+    ovr::VR_Shutdown();
+    loop_.reset();
+    logger::info("(vr) shut down");
+  }
+}
+
 void registerHooks() {
   // Register for notification when this is a browser process
   process::OnBrowser.attach(onBrowserProcess);
+
+  // Device changes are picked up by the same tick's pose query, so they're handled on the VR thread
+  OnVREvent(ovr::VREvent_TrackedDeviceActivated, EventThread::VR).attach(onDeviceActivated);
+  OnVREvent(ovr::VREvent_TrackedDeviceDeactivated, EventThread::VR).attach(onDeviceDeactivated);
+  OnVREvent(ovr::VREvent_PropertyChanged, EventThread::VR).attach(onPropertyChanged);
 }
 
 }} // module exports
@@ -8,11 +8,15 @@
  */
 #pragma once
 
+#include <chrono>
+#include <memory>
 #include <optional>
+#include <vector>
 #include "openvr.h"
 #include "mathfu/glsl_mappings.h"
 
 #include "events.h"
+#include "ovrly.h"
 
 #include "gfx.h"
 
@@ -29,6 +33,9 @@ namespace ovrly { namespace vr {
 
  /** The pixel datatype that the overlay subclass provides for rendering */
 
+  // The textures an overlay's paints are uploaded to and handed to OpenVR from, private to `vrovrly`
+  struct OverlayTextures;
+
  /**
  * A base class that represents the concept of an overlay running in the 3d space
  * of the user's virtual environment.
@@ -70,6 +77,10 @@ namespace ovrly { namespace vr {
        *
        * Only buffers with 32-bit pixels are supported, in one of the formats
        * specified in `gfx::BufferFormat`.
+       *
+       * The dirty regions are copied out of the buffer before returning, the
+       * upload to the overlay's texture happens on the upload thread. Without
+       * one, the buffer is uploaded to the texture before returning.
        */
       void render(const void *buffer, const std::vector<mathfu::recti> &dirty);
 
@@ -108,10 +119,15 @@ namespace ovrly { namespace vr {
        */
       void updateTargetSize(mathfu::vec2i size, const std::tuple<mathfu::vec2, mathfu::vec2> &bounds);
 
+      /**
+       * For subclasses to paint the whole target again, called when a paint
+       * couldn't be staged and its buffer is gone once `render()` returns.
+       */
+      virtual void invalidate() {}
+
     private:
       mathfu::vec2 size_;
-      ::gfx::tex2_ptr texture_;
-      ::vr::Texture_t vrtexture_;
+      std::shared_ptr<OverlayTextures> textures_; // Shared with the upload thread while it has paints of them
       ::vr::VROverlayHandle_t vroverlay_;
       ::vr::HmdMatrix34_t transform_{ { {1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0} } };
       ::vr::VROverlayHandle_t parent_{ ::vr::k_ulOverlayHandleInvalid };
@@ -133,6 +149,14 @@ namespace ovrly { namespace vr {
     ::vr::ETrackingResult result{ ::vr::ETrackingResult::TrackingResult_Uninitialized };
   };
 
+  /**
+   * A device pose along with when it was sampled
+   */
+  struct TimedPose {
+    std::chrono::steady_clock::time_point time;
+    DevicePose pose;
+  };
+
   /**
    * An abstraction for the VR API's tracked devices
    */
@@ -152,6 +176,7 @@ namespace ovrly { namespace vr {
     bool connected{ false }; // Flags device connected state while keeping its assigned slot
 
     std::optional<DevicePose> pose; // Position, rotation, and velocity information
+    std::optional<DevicePose> predicted; // `pose` as predicted for when the current frame's photons are displayed
 
     std::wstring manufacturer;
     std::wstring model;
@@ -159,17 +184,149 @@ namespace ovrly { namespace vr {
   };
 
 
+  /**
+   * Timing of the VR thread's wakeups against the headset display, over the
+   * most recent window of about a second
+   */
+  struct SchedulerStats {
+    float frequency{ 0 }; // Display frequency being paced to, in Hz
+    float phase{ 0 }; // Seconds before vsync the thread aims to wake
+    uint64_t frames{ 0 }; // Display frames sampled since VR was initialized
+    uint64_t missed{ 0 }; // Display frames skipped since VR was initialized, from waking too late
+    float jitterMean{ 0 }; // Mean seconds the thread woke past its target
+    float jitterMax{ 0 }; // Most seconds the thread woke past its target
+    float photonsMean{ 0 }; // Mean seconds from sampling poses to their photons being displayed
+  };
+
+  /**
+   * Counters of the runtime events handled by the VR thread since VR was initialized
+   */
+  struct EventStats {
+    unsigned budget{ 0 }; // Most events handled per tick
+    uint64_t ticks{ 0 }; // Times the thread handled events before sampling poses
+    uint64_t events{ 0 }; // Events handled
+    unsigned maxPerTick{ 0 }; // Most events handled in a single tick
+    uint64_t deferred{ 0 }; // Ticks that used their whole budget, likely leaving events for the next one
+    uint64_t skipped{ 0 }; // Events with no handlers
+    uint64_t mainDropped{ 0 }; // Events for main thread handlers dropped for a later one of the same type and device while the main thread fell behind
+  };
+
+  /**
+   * Timings of getting overlay paints to OpenVR since VR was initialized
+   *
+   * Paints are staged on the thread painting and uploaded by the upload thread,
+   * times are spent on those threads, not waiting on the GPU's copies.
+   */
+  struct UploadStats {
+    uint64_t frames{ 0 }; // Paints staged
+    uint64_t bytes{ 0 }; // Bytes of paint staged, only the dirty regions of partial paints
+    float stageLast{ 0 }; // Seconds the last paint held up the painting thread
+    float stageMean{ 0 }; // Mean seconds paints held up the painting thread
+    float stageMax{ 0 }; // Most seconds a paint held up the painting thread
+    uint64_t dropped{ 0 }; // Paints that found every staging buffer busy, the overlay is asked to paint again
+    uint64_t direct{ 0 }; // Paints uploaded straight from the paint buffer on the painting thread, with no upload thread
+    uint64_t uploads{ 0 }; // Paints uploaded to textures by the upload thread
+    float uploadLast{ 0 }; // Seconds the upload thread spent on the last paint
+    float uploadMean{ 0 }; // Mean seconds the upload thread spent on a paint
+    float uploadMax{ 0 }; // Most seconds the upload thread spent on a paint
+  };
+
+  /** Where handlers of a runtime event are called */
+  enum class EventThread {
+    VR, // On the VR thread as soon as the event is polled, handlers must be quick and thread-safe
+    Main, // On the main thread, along with the other events polled in the same VR frame
+  };
+
+  /**
+   * Gets the event raised for runtime events of `type` on `thread`, to attach handlers to
+   *
+   * Events of types without handlers are skipped at the cost of a table lookup.
+   * Handlers must be attached before VR is initialized (e.g. from `registerHooks()`),
+   * the routing table isn't locked once the VR thread is running. Later calls
+   * get an event that is never raised.
+   */
+  Event<const ::vr::VREvent_t&> &OnVREvent(::vr::EVREventType type, EventThread thread);
+
   /** Raised when the VR system is initialized and ready to go */
   extern Event<> OnReady;
 
-  /** Raised when device state is updated from the VR system */
-  extern Event<std::shared_ptr<const std::vector<TrackedDevice>>> OnDevicesUpdated;
+  /**
+   * An immutable snapshot of the device states known by the VR system
+   *
+   * Cheap to copy, but holding on to one keeps the VR thread from reusing its
+   * buffer, so they shouldn't be kept longer than needed.
+   */
+  typedef SnapshotRing<std::vector<TrackedDevice>>::Handle DeviceSnapshot;
+
+  /**
+   * Raised when device state is updated from the VR system
+   *
+   * Updates are coalesced, a busy main thread gets only the latest snapshot
+   * once it gets to them.
+   */
+  extern Event<DeviceSnapshot> OnDevicesUpdated;
+
+  /**
+   * Raised with the slot and property of each device property that changed
+   *
+   * Raised after the `OnDevicesUpdated` carrying the new value. Only properties
+   * kept in `TrackedDevice` are tracked.
+   */
+  extern Event<unsigned, ::vr::ETrackedDeviceProperty> OnDevicePropertyChanged;
+
+  /**
+   * Raised with the runtime's index of each display frame, when the VR thread
+   * wakes ahead of the frame's vsync, for pacing work to the headset
+   *
+   * Only raised once `paceDisplayFrames()` has been called. Frames are
+   * coalesced when the main thread falls behind, so handlers should compare
+   * indices rather than count calls.
+   */
+  extern Event<uint64_t> OnDisplayFrame;
+
+  /** Starts raising `OnDisplayFrame`, it costs a main thread task per display frame so is off until needed */
+  void paceDisplayFrames();
 
-  /** Gets a list of devices states currently known by the VR system */
-  const std::vector<TrackedDevice> &getDevices();
+  /** Gets the latest snapshot of device states known by the VR system */
+  DeviceSnapshot getDevices();
+
+  /**
+   * Gets the pose of the device in `slot` at `time` from its recent pose history
+   *
+   * Poses are interpolated between the samples on either side of `time`, and
+   * extrapolated with the latest sample's velocities for times a little past it.
+   * Empty when the history doesn't reach back to `time`, or it's too far ahead.
+   *
+   * Safe to call from any thread, it never blocks the VR thread or calls the runtime.
+   */
+  std::optional<DevicePose> poseAt(unsigned slot, std::chrono::steady_clock::time_point time);
+
+  /**
+   * Gets the samples of the device in `slot`'s pose history from the last
+   * `duration`, oldest first
+   *
+   * Safe to call from any thread, it never blocks the VR thread or calls the runtime.
+   */
+  std::vector<TimedPose> window(unsigned slot, std::chrono::steady_clock::duration duration);
 
   const ::vr::HmdQuad_t getPlaybounds();
 
+  /** Gets the latest timing stats of the VR thread's display-synchronized polling */
+  SchedulerStats getSchedulerStats();
+
+  /** Gets the counters of the VR thread's runtime event handling */
+  EventStats getEventStats();
+
+  /** Gets the timings of uploading overlay paints */
+  UploadStats getUploadStats();
+
+  /**
+   * Stops the VR thread and its workers, then shuts VR down
+   *
+   * Overlays must be destroyed first. Main thread only, later calls do nothing.
+   */
+  void shutdown();
+
   /**
    * Registers to launch the vr event thread once the browser process is initialized
    */
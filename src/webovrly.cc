@@ -8,11 +8,15 @@
  */
 #include "webovrly.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <functional>
 #include <memory>
+#include <vector>
 #include <openvr.h>
 
 #include "logging.h"
+#include "ovrly.h"
 
 namespace ovr = ::vr;
 using namespace std::placeholders;
@@ -73,6 +77,25 @@ namespace {
           browser_->GetHost()->WasResized();
       }
 
+      // Has the browser produce a frame, when it's paced with external begin frames
+      void SendBeginFrame() {
+        if (browser_)
+          browser_->GetHost()->SendExternalBeginFrame();
+      }
+
+      // Has the browser paint the whole view again
+      void Invalidate() {
+        if (browser_)
+          browser_->GetHost()->Invalidate(PET_VIEW);
+      }
+
+      // Closes the browser, dropping the paint callback first so no paint arrives after its overlay is gone
+      void Close() {
+        paintcb_ = nullptr;
+        if (browser_)
+          browser_->GetHost()->CloseBrowser(true);
+      }
+
       void SetPaintCallback(std::function<void(CefRenderHandler::RectList, const void*)> callback) {
         paintcb_ = callback;
       }
@@ -81,7 +104,8 @@ namespace {
           const CefRenderHandler::RectList& dirtyRects, const void* buffer, int width, int height ) override
       {
         // Call the paint callback
-        paintcb_(dirtyRects, buffer);
+        if (paintcb_)
+          paintcb_(dirtyRects, buffer);
       }
 
     private:
@@ -129,20 +153,58 @@ namespace {
       IMPLEMENT_REFCOUNTING(WebClient);
   };
 
+  class WebOverlay;
+
+  // Overlays whose browsers are paced to the headset's display frames
+  std::vector<WebOverlay*> paced_;
+
+  // Browser frame rate when not paced to the display
+  const int FREE_FRAME_RATE = 30;
+
+  // Display frames per browser frame for overlays created without their own divisor, 0 to not pace them
+  unsigned framedivisor_{ 0 };
+
+  // Largest divisor `--web-frame-divisor=` can set, a few frames a second on any headset
+  const long MAX_FRAME_DIVISOR = 16;
+
   class WebOverlay : public vr::Overlay {
     public:
-      WebOverlay(const std::string &name, mathfu::vec2 size, CefRefPtr<WebClient> client) :
+      WebOverlay(const std::string &name, mathfu::vec2 size, CefRefPtr<WebClient> client, unsigned divisor) :
         vr::Overlay(name, size),
-        client_(client)
+        client_(client),
+        divisor_(divisor)
       {
         client->GetHandler()->SetPaintCallback([this](auto rects, auto buffer) {
           cefpaint(rects, buffer);
         });
 
+        if(divisor_) {
+          paced_.push_back(this);
+        }
+
         // Set the initial size
         onLayout(size);
       }
 
+      ~WebOverlay() {
+        std::erase(paced_, this);
+
+        // The browser outlives the overlay otherwise, and its paints would go to it
+        client_->GetHandler()->Close();
+      }
+
+      /**
+       * Sends the browser a begin frame once every `divisor_` display frames,
+       * aligned to the display frame index so overlays sharing a divisor tick together
+       */
+      void onDisplayFrame(uint64_t frame) {
+        auto tick = frame / divisor_;
+        if(tick == lasttick_) return;
+
+        lasttick_ = tick;
+        client_->GetHandler()->SendBeginFrame();
+      }
+
     protected:
       void onLayout(mathfu::vec2 size) override {
         // Calculate the pixel dimensions that the overlay will be rendered at
@@ -157,6 +219,10 @@ namespace {
         client_->GetHandler()->SetSize(psize);
       }
 
+      void invalidate() override {
+        client_->GetHandler()->Invalidate();
+      }
+
     private:
       /**
         * This gets registered with the handler to be called when the offscreen
@@ -175,8 +241,17 @@ namespace {
       }
 
       CefRefPtr<WebClient> client_;
+      unsigned divisor_; // Display frames per browser frame, 0 when the browser runs on its own timer
+      uint64_t lasttick_{ UINT64_MAX };
   };
 
+  // Sends begin frames to the paced browsers that are due one
+  void onDisplayFrame(uint64_t frame) {
+    for(auto overlay: paced_) {
+      overlay->onDisplayFrame(frame);
+    }
+  }
+
  } // module local
 
 
@@ -186,7 +261,27 @@ namespace {
 
 Event<Client&> OnClient;
 
-std::unique_ptr<vr::Overlay> Create(const std::string &name, mathfu::vec2 size, std::string const &url) {
+std::unique_ptr<vr::Overlay> Create(const std::string &name, mathfu::vec2 size, std::string const &url, unsigned frameDivisor) {
+  // The default divisor can be set with `--web-frame-divisor=`, which paces every browser to the display
+  static bool configured = false;
+  if(!configured) {
+    configured = true;
+
+    if(auto divisor = getIntSwitch("web-frame-divisor")) {
+      framedivisor_ = static_cast<unsigned>(std::clamp<long>(*divisor, 0, MAX_FRAME_DIVISOR));
+      if(static_cast<long>(framedivisor_) != *divisor) {
+        logger::warn("(web) --web-frame-divisor={} is out of range, using {}", *divisor, framedivisor_);
+      }
+    }
+
+    vr::OnDisplayFrame.attach(onDisplayFrame);
+  }
+
+  auto divisor = frameDivisor ? frameDivisor : framedivisor_;
+  if(divisor) {
+    vr::paceDisplayFrames();
+  }
+
   CefRefPtr<ClientHandler> handler = new ClientHandler();
 
   OnClient(*handler);
@@ -198,16 +293,19 @@ std::unique_ptr<vr::Overlay> Create(const std::string &name, mathfu::vec2 size,
   window_info.windowless_rendering_enabled = true;
   window_info.SetAsWindowless(0);
 
-  // Specify the chromium render framerate
+  // Paced browsers only produce frames when sent a begin frame, just ahead of the display needing them
+  window_info.external_begin_frame_enabled = divisor != 0;
+
+  // Specify the chromium render framerate, for browsers running on their own timer
   CefBrowserSettings settings;
-  settings.windowless_frame_rate = 30;
+  settings.windowless_frame_rate = FREE_FRAME_RATE;
 
   logger::info("OVRLY Creating Web Overlay");
 
   // Rez the actual chromium browser
   CefBrowserHost::CreateBrowser(window_info, client, url.c_str(), settings, nullptr, nullptr);
 
-  return std::make_unique<WebOverlay>(name, size, client);
+  return std::make_unique<WebOverlay>(name, size, client, divisor);
 }
 
 }} // module exports
@@ -53,7 +53,12 @@ extern Event<Client&> OnClient;
 
 /**
  * Create a new web client and get a reference to its `CefClient`
+ *
+ * With a `frameDivisor` the browser produces a frame every that many headset
+ * display frames, driven by the VR thread's frame pacing rather than its own
+ * timer. 0 uses `--web-frame-divisor=`, and without that the browser runs at
+ * a fixed 30fps.
  */
-std::unique_ptr<vr::Overlay> Create(const std::string &name, mathfu::vec2 size, std::string const &url);
+std::unique_ptr<vr::Overlay> Create(const std::string &name, mathfu::vec2 size, std::string const &url, unsigned frameDivisor = 0);
 
 }} // namespaces